@@ -0,0 +1,330 @@
+// bench_tracker.c
+//
+// Throughput microbenchmark for the leak tracker. For every combination of
+//   mode        raw (libc malloc/free), tracked (my_malloc/my_free, every
+//               block tracked) or sampled (1 in 64 blocks tracked)
+//   threads     number of worker threads
+//   live        live-set size in blocks (split evenly between threads)
+//   size        allocation size in bytes
+// it fills the live set, then replaces random blocks (one free + one malloc,
+// a "pair") for a fixed time and writes one CSV row:
+//
+//   mode,threads,live_blocks,alloc_size,pairs,seconds,pairs_per_sec,ns_per_pair,fill_seconds
+//
+// ns_per_pair is the average latency seen by one thread. Each configuration
+// runs in a forked child so heaps and tracker state never leak between rows
+// and the tracker's exit report is skipped (the child ends with _exit).
+//
+// Usage: bench/bench_tracker [-o out.csv] [-t seconds] [-n live,...]
+//                            [-s size,...] [-j threads,...] [-m mode,...]
+//                            [-M max_mb]
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "leak_tracker.h"
+
+/* The benchmark calls both allocators explicitly, so drop the macros */
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+#define MAX_LIST 32
+
+typedef struct BenchMode {
+    const char* name;
+    void* (*alloc)(size_t size);
+    void  (*release)(void* ptr);
+    size_t overhead;   // rough per-block metadata cost, for the memory cap
+    unsigned long sample_interval;   // passed to the tracker, 0 = not tracked
+} BenchMode;
+
+static void* raw_alloc(size_t size)     { return malloc(size); }
+static void  raw_release(void* ptr)     { free(ptr); }
+static void* tracked_alloc(size_t size) { return my_malloc(size, LT_SITE(LT_SITE_MALLOC)); }
+static void  tracked_release(void* ptr) { my_free(ptr, LT_SITE(LT_SITE_FREE)); }
+
+static const BenchMode modes[] = {
+    { "raw",     raw_alloc,     raw_release,     0,  0  },
+    { "tracked", tracked_alloc, tracked_release, 64, 1  },
+    { "sampled", tracked_alloc, tracked_release, 64, 64 },
+};
+#define NUM_MODES (sizeof(modes) / sizeof(modes[0]))
+
+typedef struct Worker {
+    const BenchMode* mode;
+    void**           slots;
+    size_t           nslots;
+    size_t           size;
+    uint64_t         rng;
+    double           deadline;
+    uint64_t         pairs;
+    pthread_barrier_t* start;
+} Worker;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static void* worker_main(void* arg) {
+    Worker* w = (Worker*)arg;
+    pthread_barrier_wait(w->start);
+
+    // Check the clock in batches; the batch doubles while it stays under
+    // a millisecond so slow configurations cannot overshoot the deadline.
+    size_t batch = 1;
+    for (;;) {
+        double t0 = now_seconds();
+        if (t0 >= w->deadline) {
+            break;
+        }
+        for (size_t k = 0; k < batch; k++) {
+            size_t i = (size_t)(xorshift64(&w->rng) % w->nslots);
+            w->mode->release(w->slots[i]);
+            w->slots[i] = w->mode->alloc(w->size);
+        }
+        w->pairs += batch;
+        if (batch < 4096 && now_seconds() - t0 < 1e-3) {
+            batch *= 2;
+        }
+    }
+    return NULL;
+}
+
+/* Runs one configuration; returns 0 and fills the out-params on success */
+static int run_config(const BenchMode* mode, int threads, size_t live, size_t size,
+                      double duration, uint64_t* pairs, double* seconds, double* fill) {
+    void** slots = (void**)malloc(live * sizeof(void*));
+    Worker* workers = (Worker*)calloc((size_t)threads, sizeof(Worker));
+    pthread_t* tids = (pthread_t*)calloc((size_t)threads, sizeof(pthread_t));
+    if (!slots || !workers || !tids) {
+        return -1;
+    }
+    if (mode->sample_interval) {
+        tracker_set_sample_interval(mode->sample_interval);
+    }
+
+    double t0 = now_seconds();
+    for (size_t i = 0; i < live; i++) {
+        slots[i] = mode->alloc(size);
+        if (!slots[i]) {
+            return -1;
+        }
+    }
+    *fill = now_seconds() - t0;
+
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, (unsigned)threads + 1);
+    size_t per_thread = live / (size_t)threads;
+    for (int t = 0; t < threads; t++) {
+        workers[t].mode   = mode;
+        workers[t].slots  = slots + (size_t)t * per_thread;
+        workers[t].nslots = (t == threads - 1) ? live - (size_t)t * per_thread : per_thread;
+        workers[t].size   = size;
+        workers[t].rng    = 0x9E3779B97F4A7C15ULL * (uint64_t)(t + 1);
+        workers[t].start  = &start;
+        if (pthread_create(&tids[t], NULL, worker_main, &workers[t]) != 0) {
+            return -1;
+        }
+    }
+
+    double begin = now_seconds();
+    for (int t = 0; t < threads; t++) {
+        workers[t].deadline = begin + duration;
+    }
+    pthread_barrier_wait(&start);
+
+    *pairs = 0;
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+        *pairs += workers[t].pairs;
+    }
+    *seconds = now_seconds() - begin;
+    return 0;
+}
+
+/* Parses "a,b,c" into out[]; returns the count or -1 */
+static int parse_list(const char* arg, size_t* out) {
+    int n = 0;
+    const char* p = arg;
+    while (*p && n < MAX_LIST) {
+        char* end;
+        errno = 0;
+        unsigned long long v = strtoull(p, &end, 10);
+        if (errno || end == p || v == 0) {
+            return -1;
+        }
+        out[n++] = (size_t)v;
+        if (*end == ',') {
+            end++;
+        } else if (*end) {
+            return -1;
+        }
+        p = end;
+    }
+    return n;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s [-o out.csv] [-t seconds] [-n live,...] [-s size,...]\n"
+            "          [-j threads,...] [-m raw,tracked,sampled] [-M max_mb]\n", prog);
+}
+
+int main(int argc, char** argv) {
+    size_t lives[MAX_LIST]   = { 1000, 10000, 100000, 1000000, 10000000 };
+    size_t sizes[MAX_LIST]   = { 16, 256, 4096 };
+    size_t threads[MAX_LIST] = { 1, 2, 4 };
+    int nlives = 5, nsizes = 3, nthreads = 3;
+    int use_mode[NUM_MODES];
+    double duration = 0.5;
+    size_t max_mb = 1024;
+    const char* out_path = NULL;
+
+    for (size_t m = 0; m < NUM_MODES; m++) {
+        use_mode[m] = 1;
+    }
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:t:n:s:j:m:M:h")) != -1) {
+        switch (opt) {
+        case 'o': out_path = optarg; break;
+        case 't': duration = atof(optarg); break;
+        case 'n': nlives   = parse_list(optarg, lives);   break;
+        case 's': nsizes   = parse_list(optarg, sizes);   break;
+        case 'j': nthreads = parse_list(optarg, threads); break;
+        case 'M': max_mb   = (size_t)atol(optarg); break;
+        case 'm': {
+            for (size_t m = 0; m < NUM_MODES; m++) {
+                use_mode[m] = 0;
+            }
+            char buf[256];
+            snprintf(buf, sizeof(buf), "%s", optarg);
+            for (char* tok = strtok(buf, ","); tok; tok = strtok(NULL, ",")) {
+                size_t m = 0;
+                while (m < NUM_MODES && strcmp(modes[m].name, tok) != 0) {
+                    m++;
+                }
+                if (m == NUM_MODES) {
+                    fprintf(stderr, "Unknown mode '%s'\n", tok);
+                    return 1;
+                }
+                use_mode[m] = 1;
+            }
+            break;
+        }
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (nlives <= 0 || nsizes <= 0 || nthreads <= 0 || duration <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE* out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+    fprintf(out, "mode,threads,live_blocks,alloc_size,pairs,seconds,"
+                 "pairs_per_sec,ns_per_pair,fill_seconds\n");
+    fflush(out);
+
+    for (size_t m = 0; m < NUM_MODES; m++) {
+        if (!use_mode[m]) {
+            continue;
+        }
+        for (int j = 0; j < nthreads; j++) {
+            for (int n = 0; n < nlives; n++) {
+                for (int s = 0; s < nsizes; s++) {
+                    size_t live = lives[n], size = sizes[s];
+                    int nthr = (int)threads[j];
+                    // glibc chunks are at least 32 bytes, rounded to 16
+                    size_t chunk = (size + 16 + 15) & ~(size_t)15;
+                    if (chunk < 32) {
+                        chunk = 32;
+                    }
+                    double need_mb = (double)live * (double)(chunk + modes[m].overhead
+                                                             + sizeof(void*)) / (1 << 20);
+                    if (need_mb > (double)max_mb || live < (size_t)nthr) {
+                        fprintf(stderr, "skip %s threads=%d live=%zu size=%zu (%.0f MB > -M %zu)\n",
+                                modes[m].name, nthr, live, size, need_mb, max_mb);
+                        continue;
+                    }
+
+                    int fds[2];
+                    if (pipe(fds) != 0) {
+                        perror("pipe");
+                        return 1;
+                    }
+                    fflush(out);
+                    pid_t pid = fork();
+                    if (pid == 0) {
+                        uint64_t pairs;
+                        double seconds, fill;
+                        char line[256];
+                        close(fds[0]);
+                        if (run_config(&modes[m], nthr, live, size, duration,
+                                       &pairs, &seconds, &fill) != 0) {
+                            _exit(2);
+                        }
+                        int len = snprintf(line, sizeof(line), "%s,%d,%zu,%zu,%llu,%.6f,%.0f,%.2f,%.6f\n",
+                                           modes[m].name, nthr, live, size,
+                                           (unsigned long long)pairs, seconds,
+                                           (double)pairs / seconds,
+                                           seconds * 1e9 * nthr / (double)pairs, fill);
+                        if (write(fds[1], line, (size_t)len) != len) {
+                            _exit(3);
+                        }
+                        _exit(0);
+                    }
+                    close(fds[1]);
+                    if (pid < 0) {
+                        perror("fork");
+                        return 1;
+                    }
+
+                    char line[256];
+                    ssize_t len = read(fds[0], line, sizeof(line) - 1);
+                    close(fds[0]);
+                    int status;
+                    waitpid(pid, &status, 0);
+                    if (len <= 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                        fprintf(stderr, "fail %s threads=%d live=%zu size=%zu (status %d)\n",
+                                modes[m].name, nthr, live, size, status);
+                        continue;
+                    }
+                    line[len] = '\0';
+                    fputs(line, out);
+                    fflush(out);
+                }
+            }
+        }
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,494 @@
+// workload.c
+//
+// Synthetic allocation workload generator. Drives the tracker through the
+// my_* API with a chosen allocation pattern:
+//
+//   lifo      allocate a window of blocks, free them newest-first, repeat
+//   fifo      queue of blocks; once the window is full free the oldest
+//   random    window of slots; each op frees a random slot and refills it
+//             (geometric block lifetimes)
+//   prodcons  producer threads allocate, consumer threads free (every free
+//             happens on a different thread than the allocation)
+//   realloc   blocks grow by 1.5x through realloc up to the max size, then
+//             are freed and restarted
+//
+// A fraction of the allocations (-k) is planted as leaks: those blocks are
+// never freed. With -v the generator then checks that the tracker's live set
+// is exactly the planted set (same pointers, same sizes) and exits 1 if not.
+// A summary line with ops/sec is printed to stdout.
+//
+// Usage: bench/workload [-p pattern] [-n ops] [-w window] [-s min-max]
+//                       [-k leak_rate] [-j threads] [-S seed]
+//                       [-m raw|tracked|sampled]
+//                       [-v] [-c]
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "leak_tracker.h"
+
+/* The generator calls both allocators explicitly, so drop the macros */
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+typedef struct WorkloadMode {
+    const char* name;
+    void* (*alloc)(size_t size);
+    void* (*resize)(void* ptr, size_t size);
+    void  (*release)(void* ptr);
+    unsigned long sample_interval;   // passed to the tracker, 0 = not tracked
+} WorkloadMode;
+
+static void* raw_alloc(size_t size)               { return malloc(size); }
+static void* raw_resize(void* ptr, size_t size)   { return realloc(ptr, size); }
+static void  raw_release(void* ptr)               { free(ptr); }
+static void* tracked_alloc(size_t size)             { return my_malloc(size, LT_SITE(LT_SITE_MALLOC)); }
+static void* tracked_resize(void* ptr, size_t size) { return my_realloc(ptr, size, LT_SITE(LT_SITE_REALLOC)); }
+static void  tracked_release(void* ptr)             { my_free(ptr, LT_SITE(LT_SITE_FREE)); }
+
+static const WorkloadMode modes[] = {
+    { "raw",     raw_alloc,     raw_resize,     raw_release,     0  },
+    { "tracked", tracked_alloc, tracked_resize, tracked_release, 1  },
+    { "sampled", tracked_alloc, tracked_resize, tracked_release, 64 },
+};
+#define NUM_MODES (sizeof(modes) / sizeof(modes[0]))
+
+typedef struct Planted {
+    void*  ptr;
+    size_t size;
+} Planted;
+
+typedef struct Block {
+    void*  ptr;
+    size_t size;
+} Block;
+
+/* Bounded queue carrying blocks from producers to consumers */
+typedef struct Queue {
+    Block*          items;
+    size_t          cap, head, count;
+    pthread_mutex_t lock;
+    pthread_cond_t  not_empty, not_full;
+} Queue;
+
+typedef struct Gen {
+    const WorkloadMode* mode;
+    uint64_t  rng;
+    size_t    ops;             // allocations this thread performs
+    size_t    window;
+    size_t    min_size, max_size;
+    uint64_t  leak_threshold;  // plant a leak when rng < threshold
+    Planted*  planted;
+    size_t    nplanted, planted_cap;
+    Queue*    queue;           // prodcons only
+    void    (*run)(struct Gen*);
+} Gen;
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void die(const char* msg) {
+    fprintf(stderr, "workload: %s\n", msg);
+    exit(2);
+}
+
+static size_t pick_size(Gen* g) {
+    return g->min_size + (size_t)(xorshift64(&g->rng) % (g->max_size - g->min_size + 1));
+}
+
+/*
+ * Allocate one block. Returns 1 if it is a planted leak (already recorded
+ * and never to be touched again by the pattern), 0 if the pattern owns it.
+ */
+static int gen_alloc(Gen* g, Block* out) {
+    out->size = pick_size(g);
+    out->ptr  = g->mode->alloc(out->size);
+    if (!out->ptr) {
+        die("allocation failed");
+    }
+    memset(out->ptr, 0xA5, out->size < 64 ? out->size : 64);
+    if (xorshift64(&g->rng) >= g->leak_threshold) {
+        return 0;
+    }
+    if (g->nplanted == g->planted_cap) {
+        g->planted_cap = g->planted_cap ? g->planted_cap * 2 : 256;
+        g->planted = (Planted*)realloc(g->planted, g->planted_cap * sizeof(Planted));
+        if (!g->planted) {
+            die("out of memory for planted list");
+        }
+    }
+    g->planted[g->nplanted].ptr  = out->ptr;
+    g->planted[g->nplanted].size = out->size;
+    g->nplanted++;
+    return 1;
+}
+
+static Block* new_blocks(size_t n) {
+    Block* b = (Block*)calloc(n, sizeof(Block));
+    if (!b) {
+        die("out of memory for block window");
+    }
+    return b;
+}
+
+static void run_lifo(Gen* g) {
+    Block* stack = new_blocks(g->window);
+    size_t done = 0;
+    while (done < g->ops) {
+        size_t depth = 0;
+        while (depth < g->window && done < g->ops) {
+            done++;
+            if (!gen_alloc(g, &stack[depth])) {
+                depth++;
+            }
+        }
+        while (depth > 0) {
+            g->mode->release(stack[--depth].ptr);
+        }
+    }
+    free(stack);
+}
+
+static void run_fifo(Gen* g) {
+    Block* ring = new_blocks(g->window);
+    size_t head = 0, count = 0;
+    for (size_t done = 0; done < g->ops; done++) {
+        Block b;
+        if (gen_alloc(g, &b)) {
+            continue;
+        }
+        if (count == g->window) {
+            g->mode->release(ring[head].ptr);
+            ring[head] = b;
+            head = (head + 1) % g->window;
+        } else {
+            ring[(head + count) % g->window] = b;
+            count++;
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        g->mode->release(ring[(head + i) % g->window].ptr);
+    }
+    free(ring);
+}
+
+static void run_random(Gen* g) {
+    Block* slots = new_blocks(g->window);
+    for (size_t done = 0; done < g->ops; done++) {
+        size_t i = (size_t)(xorshift64(&g->rng) % g->window);
+        Block b;
+        if (gen_alloc(g, &b)) {
+            continue;
+        }
+        if (slots[i].ptr) {
+            g->mode->release(slots[i].ptr);
+        }
+        slots[i] = b;
+    }
+    for (size_t i = 0; i < g->window; i++) {
+        if (slots[i].ptr) {
+            g->mode->release(slots[i].ptr);
+        }
+    }
+    free(slots);
+}
+
+static void run_realloc(Gen* g) {
+    Block* slots = new_blocks(g->window);
+    for (size_t done = 0; done < g->ops; done++) {
+        size_t i = (size_t)(xorshift64(&g->rng) % g->window);
+        Block* b = &slots[i];
+        if (b->ptr && b->size < g->max_size) {
+            size_t grown = b->size + b->size / 2 + 1;
+            if (grown > g->max_size) {
+                grown = g->max_size;
+            }
+            void* p = g->mode->resize(b->ptr, grown);
+            if (!p) {
+                die("realloc failed");
+            }
+            b->ptr  = p;
+            b->size = grown;
+            continue;
+        }
+        if (b->ptr) {
+            g->mode->release(b->ptr);
+            b->ptr = NULL;
+        }
+        Block nb;
+        if (!gen_alloc(g, &nb)) {
+            *b = nb;
+        }
+    }
+    for (size_t i = 0; i < g->window; i++) {
+        if (slots[i].ptr) {
+            g->mode->release(slots[i].ptr);
+        }
+    }
+    free(slots);
+}
+
+static void queue_push(Queue* q, Block b) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->cap) {
+        pthread_cond_wait(&q->not_full, &q->lock);
+    }
+    q->items[(q->head + q->count) % q->cap] = b;
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static Block queue_pop(Queue* q) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0) {
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    }
+    Block b = q->items[q->head];
+    q->head = (q->head + 1) % q->cap;
+    q->count--;
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return b;
+}
+
+static void run_producer(Gen* g) {
+    for (size_t done = 0; done < g->ops; done++) {
+        Block b;
+        if (!gen_alloc(g, &b)) {
+            queue_push(g->queue, b);
+        }
+    }
+    Block stop = { NULL, 0 };
+    queue_push(g->queue, stop);
+}
+
+static void run_consumer(Gen* g) {
+    for (;;) {
+        Block b = queue_pop(g->queue);
+        if (!b.ptr) {
+            break;
+        }
+        g->mode->release(b.ptr);
+    }
+}
+
+static void* gen_thread(void* arg) {
+    Gen* g = (Gen*)arg;
+    g->run(g);
+    return NULL;
+}
+
+/* ----- Verification against the tracker's live set ----- */
+
+typedef struct VerifyCtx {
+    Planted* planted;      // sorted by pointer
+    size_t   nplanted;
+    size_t   matched;
+    size_t   unexpected;
+    size_t   wrong_size;
+} VerifyCtx;
+
+static int cmp_planted(const void* a, const void* b) {
+    uintptr_t pa = (uintptr_t)((const Planted*)a)->ptr;
+    uintptr_t pb = (uintptr_t)((const Planted*)b)->ptr;
+    return (pa > pb) - (pa < pb);
+}
+
+static void verify_block(void* ptr, size_t size, const char* file, int line, void* arg) {
+    VerifyCtx* v = (VerifyCtx*)arg;
+    Planted key = { ptr, 0 };
+    Planted* hit = (Planted*)bsearch(&key, v->planted, v->nplanted, sizeof(Planted), cmp_planted);
+    if (!hit) {
+        if (v->unexpected++ < 10) {
+            fprintf(stderr, "verify: live block %p (%zu bytes, %s:%d) was not planted\n",
+                    ptr, size, file, line);
+        }
+    } else if (hit->size != size) {
+        if (v->wrong_size++ < 10) {
+            fprintf(stderr, "verify: planted block %p has size %zu, tracker says %zu\n",
+                    ptr, hit->size, size);
+        }
+    } else {
+        v->matched++;
+    }
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s [-p lifo|fifo|random|prodcons|realloc] [-n ops] [-w window]\n"
+            "          [-s min-max] [-k leak_rate] [-j threads] [-S seed]\n"
+            "          [-m raw|tracked|sampled] [-v] [-c]\n", prog);
+}
+
+int main(int argc, char** argv) {
+    const char* pattern = "random";
+    size_t ops = 1000000, window = 10000, min_size = 16, max_size = 512;
+    double leak_rate = 0.0;
+    int threads = 1, verify = 0, cleanup = 0;
+    uint64_t seed = 1;
+    const WorkloadMode* mode = &modes[1];
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:n:w:s:k:j:S:m:vch")) != -1) {
+        switch (opt) {
+        case 'p': pattern = optarg; break;
+        case 'n': ops     = (size_t)strtoull(optarg, NULL, 10); break;
+        case 'w': window  = (size_t)strtoull(optarg, NULL, 10); break;
+        case 's':
+            if (sscanf(optarg, "%zu-%zu", &min_size, &max_size) != 2) {
+                min_size = max_size = (size_t)strtoull(optarg, NULL, 10);
+            }
+            break;
+        case 'k': leak_rate = atof(optarg); break;
+        case 'j': threads   = atoi(optarg); break;
+        case 'S': seed      = strtoull(optarg, NULL, 10); break;
+        case 'v': verify    = 1; break;
+        case 'c': cleanup   = 1; break;
+        case 'm': {
+            size_t m = 0;
+            while (m < NUM_MODES && strcmp(modes[m].name, optarg) != 0) {
+                m++;
+            }
+            if (m == NUM_MODES) {
+                fprintf(stderr, "Unknown mode '%s'\n", optarg);
+                return 1;
+            }
+            mode = &modes[m];
+            break;
+        }
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    void (*run)(Gen*) = NULL;
+    int prodcons = 0;
+    if (strcmp(pattern, "lifo") == 0)          run = run_lifo;
+    else if (strcmp(pattern, "fifo") == 0)     run = run_fifo;
+    else if (strcmp(pattern, "random") == 0)   run = run_random;
+    else if (strcmp(pattern, "realloc") == 0)  run = run_realloc;
+    else if (strcmp(pattern, "prodcons") == 0) prodcons = 1;
+    if ((!run && !prodcons) || ops == 0 || window == 0 || threads <= 0 ||
+        min_size == 0 || min_size > max_size || leak_rate < 0.0 || leak_rate > 1.0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (verify && mode->sample_interval != 1) {
+        fprintf(stderr, "workload: -v needs the tracked mode\n");
+        return 1;
+    }
+    if (mode->sample_interval) {
+        tracker_set_sample_interval(mode->sample_interval);
+    }
+
+    // prodcons runs one consumer per producer
+    int nthreads = prodcons ? threads * 2 : threads;
+    Gen* gens = (Gen*)calloc((size_t)nthreads, sizeof(Gen));
+    pthread_t* tids = (pthread_t*)calloc((size_t)nthreads, sizeof(pthread_t));
+    Queue queue;
+    if (!gens || !tids) {
+        die("out of memory");
+    }
+    if (prodcons) {
+        queue.items = new_blocks(window);
+        queue.cap   = window;
+        queue.head  = queue.count = 0;
+        pthread_mutex_init(&queue.lock, NULL);
+        pthread_cond_init(&queue.not_empty, NULL);
+        pthread_cond_init(&queue.not_full, NULL);
+    }
+
+    uint64_t threshold = leak_rate >= 1.0 ? UINT64_MAX
+                                          : (uint64_t)(leak_rate * 18446744073709551616.0);
+    for (int t = 0; t < nthreads; t++) {
+        Gen* g = &gens[t];
+        g->mode           = mode;
+        g->rng            = (seed + 1) * 0x9E3779B97F4A7C15ULL + (uint64_t)t * 0xBF58476D1CE4E5B9ULL;
+        g->ops            = ops / (size_t)threads + ((size_t)(t % threads) < ops % (size_t)threads);
+        g->window         = window;
+        g->min_size       = min_size;
+        g->max_size       = max_size;
+        g->leak_threshold = threshold;
+        g->queue          = &queue;
+        g->run            = prodcons ? (t < threads ? run_producer : run_consumer) : run;
+    }
+
+    double t0 = now_seconds();
+    for (int t = 0; t < nthreads; t++) {
+        if (pthread_create(&tids[t], NULL, gen_thread, &gens[t]) != 0) {
+            die("pthread_create failed");
+        }
+    }
+    for (int t = 0; t < nthreads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    double seconds = now_seconds() - t0;
+
+    // Gather the planted leaks of all threads
+    size_t nplanted = 0;
+    for (int t = 0; t < nthreads; t++) {
+        nplanted += gens[t].nplanted;
+    }
+    Planted* planted = (Planted*)malloc((nplanted ? nplanted : 1) * sizeof(Planted));
+    if (!planted) {
+        die("out of memory");
+    }
+    nplanted = 0;
+    for (int t = 0; t < nthreads; t++) {
+        memcpy(planted + nplanted, gens[t].planted, gens[t].nplanted * sizeof(Planted));
+        nplanted += gens[t].nplanted;
+        free(gens[t].planted);
+    }
+
+    printf("pattern=%s mode=%s threads=%d ops=%zu window=%zu sizes=%zu-%zu seed=%llu "
+           "planted=%zu seconds=%.6f ops_per_sec=%.0f\n",
+           pattern, mode->name, threads, ops, window, min_size, max_size,
+           (unsigned long long)seed, nplanted, seconds, (double)ops / seconds);
+
+    int status = 0;
+    if (verify) {
+        VerifyCtx v = { planted, nplanted, 0, 0, 0 };
+        qsort(planted, nplanted, sizeof(Planted), cmp_planted);
+        tracker_foreach_live(verify_block, &v);
+        tracker_stats st;
+        tracker_get_stats(&st);
+        if (v.matched == nplanted && v.unexpected == 0 && v.wrong_size == 0 &&
+            st.live_blocks == nplanted) {
+            printf("verify: OK, all %zu planted leak(s) found exactly\n", nplanted);
+        } else {
+            printf("verify: FAILED, %zu of %zu planted found, %zu unexpected, %zu wrong size\n",
+                   v.matched, nplanted, v.unexpected, v.wrong_size);
+            status = 1;
+        }
+    }
+    if (cleanup) {
+        for (size_t i = 0; i < nplanted; i++) {
+            mode->release(planted[i].ptr);
+        }
+    }
+    free(planted);
+    free(gens);
+    free(tids);
+    return status;
+}
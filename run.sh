@@ -9,6 +9,10 @@
 #   4. Run 'make clean && make' to compile main.c + src/leak_tracker.c.
 #   5. Execute ./leak_test_exec.
 #   6. Clean up all artifacts (main.c, *.o, leak_test_exec).
+#
+# With LEAK_TRACKER_OUTPUT_DIR set, every process of the run (including
+# forked and exec'd children) writes its report into that directory, and
+# step 5 ends with the merged report from tools/lt-merge.sh.
 
 set -e
 
@@ -57,7 +61,15 @@ make
 echo
 echo "Running './leak_test_exec'..."
 echo
-./leak_test_exec
+if [ -n "$LEAK_TRACKER_OUTPUT_DIR" ]; then
+    mkdir -p "$LEAK_TRACKER_OUTPUT_DIR"
+    rm -f "$LEAK_TRACKER_OUTPUT_DIR"/leak_tracker.*.txt
+    ./leak_test_exec
+    echo
+    "$(dirname "$0")/tools/lt-merge.sh" "$LEAK_TRACKER_OUTPUT_DIR"
+else
+    ./leak_test_exec
+fi
 echo
 
 # 8) Clean up all generated files
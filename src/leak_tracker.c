@@ -5,201 +5,3938 @@
  * Now tracks double‐free vs invalid‐free separately.
  */
 
+ #define _GNU_SOURCE     // fallocate()
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
+ #include <limits.h>
+ #include <stdint.h>
+ #include <stdarg.h>
+ #include <errno.h>
+ #include <time.h>
+ #include <pthread.h>
+ #include <signal.h>
+ #include <fcntl.h>
+ #include <unistd.h>
+ #include <sys/mman.h>
  #include "leak_tracker.h"
+ #if LEAK_TRACKER_STACKS
+ #include <execinfo.h>
+ #endif
+ 
+ /* Undefine macros so we can call the real malloc/free here */
+ #ifdef malloc
+ #undef malloc
+ #endif
+ #ifdef calloc
+ #undef calloc
+ #endif
+ #ifdef realloc
+ #undef realloc
+ #endif
+ #ifdef free
+ #undef free
+ #endif
+ #ifdef tracker_get_stats
+ #undef tracker_get_stats
+ #undef tracker_foreach_live
+ #undef tracker_foreach_site
+ #undef tracker_set_sample_interval
+ #undef tracker_set_mode
+ #undef tracker_get_mode
+ #undef tracker_set_overhead_budget
+ #undef tracker_find_block
+ #undef tracker_set_budget
+ #undef tracker_set_site_budget
+ #undef tracker_set_budget_handler
+ #undef tracker_fail_nth
+ #undef tracker_fail_sites
+ #undef tracker_fail_clear
+ #undef tracker_get_injections
+ #undef tracker_set_tag
+ #undef tracker_name_tag
+ #undef tracker_get_tag_stats
+ #undef tracker_set_tag_budget
+ #undef tracker_thread_id
+ #undef tracker_get_thread_stats
+ #undef tracker_set_thread_exit_report
+ #undef tracker_foreach_cross_free
+ #undef tracker_foreach_site_pair
+ #undef tracker_set_crash_report
+ #undef tracker_set_metadata_file
+ #undef tracker_set_report_file
+ #endif
+ 
+ /* Guard bytes appended to every tracked block (0 = no redzones) */
+ #if LEAK_TRACKER_REDZONES
+ #define REDZONE_BYTES   ((size_t)LEAK_TRACKER_REDZONE_SIZE)
+ #define REDZONE_PATTERN 0xFB
+ #else
+ #define REDZONE_BYTES   ((size_t)0)
+ #endif
+ 
+ /* ----- Allocation tracking ----- */
+ 
+ #if LEAK_TRACKER_TRACK
+ /*
+  * Every tracked block, and every freed pointer kept for double-free
+  * checks, is one 24-byte record in an open-addressing hash table (linear
+  * probing, backward-shift deletion). The table is mmap'd, so it neither
+  * lives in nor recurses into the heap it watches. Size, tag and the freed
+  * flag share the 'meta' word.
+  */
+ typedef struct BlockRec {
+     void*     ptr;      // block address, NULL = empty slot
+     lt_site*  site;     // call site that allocated it
+     uint64_t  meta;     // REC_* fields
+ } BlockRec;
+ 
+ /*
+  * A freed record keeps the allocating site in 'site' and, instead of the
+  * size, the id of the site that freed it (REC_FREE_SITE), so a later
+  * double free can name all three calls without a bigger record.
+  */
+ #define REC_SIZE_BITS   40                              // blocks up to 1 TiB
+ #define REC_SIZE_MASK   ((UINT64_C(1) << REC_SIZE_BITS) - 1)
+ #define REC_TAG_SHIFT   40                              // 8-bit tag
+ #define REC_THREAD_SHIFT 48                             // 12-bit thread id
+ #define REC_THREAD_MASK ((UINT64_C(1) * LT_MAX_THREADS - 1) << REC_THREAD_SHIFT)
+ #define REC_INHERITED   (UINT64_C(1) << 62)             // allocated before fork()
+ #define REC_FREED       (UINT64_C(1) << 63)             // freed, not live
+ #define REC_SIZE(r)     ((size_t)((r)->meta & REC_SIZE_MASK))
+ #define REC_TAG(r)      ((unsigned)((r)->meta >> REC_TAG_SHIFT) & 0xFF)
+ #define REC_THREAD(r)   ((unsigned)(((r)->meta & REC_THREAD_MASK) >> REC_THREAD_SHIFT))
+ #define REC_FREE_SITE(r) ((unsigned)((r)->meta & 0xFFFFFFFFu))  // freed records only
+ 
+ #if LEAK_TRACKER_STACKS
+ /* Call stacks sit in a parallel array, slot for slot */
+ typedef struct BlockStack {
+     int     depth;      // valid entries in frames[]
+     void*   frames[LEAK_TRACKER_STACK_DEPTH];
+ } BlockStack;
+ static BlockStack* block_stacks = NULL;
+ #endif
+ 
+ static BlockRec*   block_table  = NULL;
+ static size_t      block_cap    = 0;    // slots, a power of two
+ static size_t      block_used   = 0;    // live and freed records
+ 
+ /* Unpacked copy of a live record, for use outside the table */
+ typedef struct AllocInfo {
+     void*     ptr;
+     size_t    size;
+     lt_site*  site;
+     unsigned  tag;
+     unsigned  thread;
+ } AllocInfo;
+ 
+ /* A live record as it sat in the table */
+ typedef struct SavedRec {
+     BlockRec    rec;
+ #if LEAK_TRACKER_STACKS
+     BlockStack  stack;
+ #endif
+ } SavedRec;
+ 
+ /* Per-tag accounting of tracked blocks; tag 0 = untagged */
+ typedef struct TagStats {
+     size_t  alloc_calls;
+     size_t  bytes_allocated;
+     size_t  live_blocks;
+     size_t  live_bytes;
+     size_t  budget;     // cap on live_bytes, 0 = none
+     char    name[32];
+ } TagStats;
+ static TagStats            tag_stats[LT_MAX_TAGS];
+ static __thread unsigned   current_tag = 0;
+ 
+ /*
+  * Per-thread accounting of tracked blocks. Ids are handed out on a
+  * thread's first slow-path call and recycled when it exits; blocks it
+  * left behind then move to id 0, which also collects the threads that
+  * found every id taken.
+  */
+ typedef struct ThreadStats {
+     size_t  alloc_calls;
+     size_t  bytes_allocated;
+     size_t  live_blocks;
+     size_t  live_bytes;
+ } ThreadStats;
+ static ThreadStats         thread_stats[LT_MAX_THREADS];
+ static unsigned short      free_thread_ids[LT_MAX_THREADS];
+ static unsigned            free_thread_id_count = 0;
+ static unsigned            thread_id_seq        = 0;  // highest id handed out
+ static int                 thread_exit_reports  = 0;  // report leftovers on exit
+ static __thread unsigned   thread_index         = 0;
+ 
+ /*
+  * Blocks freed (or reallocated) on another thread than the one that
+  * allocated them, per (allocating thread, freeing thread, allocation
+  * site). Open-addressed; pairs beyond the table only reach the totals.
+  */
+ #define MAX_CROSS_FREES 1024
+ typedef struct CrossFree {
+     lt_site*  site;            // NULL = empty slot
+     unsigned short alloc_thread;
+     unsigned short free_thread;
+     size_t    blocks;
+     size_t    bytes;
+ } CrossFree;
+ static CrossFree           cross_frees[MAX_CROSS_FREES];
+ static size_t              cross_free_pairs   = 0;
+ static size_t              cross_free_blocks  = 0;
+ static size_t              cross_free_bytes   = 0;
+ 
+ /*
+  * Ownership map: tracked blocks released per (allocation site, release
+  * site), where the release site is the free or realloc that ended the
+  * block. Same layout and overflow rule as the cross-thread table.
+  */
+ #define MAX_SITE_PAIRS 2048
+ typedef struct SitePair {
+     lt_site*  alloc_site;      // NULL = empty slot
+     lt_site*  free_site;
+     size_t    blocks;
+     size_t    bytes;
+ } SitePair;
+ static SitePair            site_pairs[MAX_SITE_PAIRS];
+ static size_t              site_pair_count    = 0;
+ static size_t              site_pair_dropped  = 0;   // releases not in the table
+ 
+ /* Byte cap on the live tracked blocks of matching call sites */
+ #define MAX_BUDGETS 32
+ typedef struct Budget {
+     char    file[128];  // path, or a suffix of one after a '/'
+     int     line;       // 0 = every site in the file
+     size_t  limit;      // 0 = no cap
+     size_t  in_use;     // live tracked bytes of the sites bound to it
+ } Budget;
+ 
+ static Budget            budgets[MAX_BUDGETS];
+ static int               budget_count        = 0;
+ static size_t            global_budget       = 0;     // cap on live_byte_count, 0 = none
+ static int               budgets_active      = 0;     // any cap set: track everything
+ static size_t            budget_denial_count = 0;
+ static tracker_budget_fn budget_handler      = NULL;
+ static void*             budget_handler_ctx  = NULL;
+ #endif /* LEAK_TRACKER_TRACK */
+ 
+ #if LEAK_TRACKER_COUNT
+ /* Counters */
+ static size_t total_alloc_calls      = 0;
+ static size_t total_free_calls       = 0;
+ static size_t total_bytes_allocated  = 0;
+ #endif
+ #if LEAK_TRACKER_TRACK
+ static size_t total_bytes_freed      = 0;
+ static size_t invalid_free_count     = 0;
+ static size_t double_free_count      = 0;
+ static size_t live_block_count       = 0;
+ static size_t live_byte_count        = 0;
+ static size_t inherited_blocks       = 0;   // live blocks the parent allocated before fork()
+ static size_t inherited_bytes        = 0;
+ #endif
+ #if LEAK_TRACKER_REDZONES
+ static size_t redzone_overflow_count = 0;
+ #endif
+ 
+ #if LEAK_TRACKER_ENABLED
+ /* atexit handler registration flag */
+ static int    atexit_registered = 0;
+ 
+ /*
+  * Report output: text gathered in a buffer and handed to write(2), with
+  * the numbers of the hot lines formatted by hand. The exit report uses a
+  * multi-MB buffer, so a million leaked blocks cost a few dozen write(2)
+  * calls instead of a million stdio round trips; the crash handler uses a
+  * small one on its stack (no malloc, no stdio, no locks there).
+  */
+ typedef struct LtWriter {
+     int    fd;
+     size_t len;
+     size_t cap;
+     char*  buf;
+ } LtWriter;
+ 
+ #define REPORT_BUF_SIZE (4u << 20)
+ 
+ /* Where the exit report goes: stdout, or a file (report_open) */
+ static LtWriter report_out;
+ static char     report_pattern[1024];   // tracker_set_report_file(), "%p" unexpanded
+ 
+ static void w_flush(LtWriter* w) {
+     size_t off = 0;
+     while (off < w->len) {
+         ssize_t n = write(w->fd, w->buf + off, w->len - off);
+         if (n < 0 && errno == EINTR) {
+             continue;
+         }
+         if (n <= 0) {
+             break;
+         }
+         off += (size_t)n;
+     }
+     w->len = 0;
+ }
+ 
+ static void w_mem(LtWriter* w, const char* s, size_t n) {
+     if (n <= w->cap - w->len) {
+         memcpy(w->buf + w->len, s, n);
+         w->len += n;
+         return;
+     }
+     while (n) {
+         if (w->len == w->cap) {
+             w_flush(w);
+         }
+         size_t k = w->cap - w->len;
+         k = k < n ? k : n;
+         memcpy(w->buf + w->len, s, k);
+         w->len += k;
+         s += k;
+         n -= k;
+     }
+ }
+ 
+ static void w_str(LtWriter* w, const char* s) {
+     w_mem(w, s, strlen(s));
+ }
+ 
+ static void w_u64(LtWriter* w, uint64_t v) {
+     char tmp[20];
+     int  n = 0;
+     do {
+         tmp[sizeof(tmp) - ++n] = (char)('0' + v % 10);
+         v /= 10;
+     } while (v);
+     w_mem(w, tmp + sizeof(tmp) - n, (size_t)n);
+ }
+ 
+ #if LEAK_TRACKER_TRACK
+ /* Same text as printf's %p: 0x and lower-case hex, "(nil)" for NULL */
+ static void w_ptr(LtWriter* w, const void* p) {
+     static const char digits[] = "0123456789abcdef";
+     uintptr_t v = (uintptr_t)p;
+     if (!v) {
+         w_str(w, "(nil)");
+         return;
+     }
+     char tmp[2 + 2 * sizeof(v)];
+     int  n = 0;
+     while (v) {
+         tmp[sizeof(tmp) - ++n] = digits[v & 0xF];
+         v >>= 4;
+     }
+     tmp[sizeof(tmp) - ++n] = 'x';
+     tmp[sizeof(tmp) - ++n] = '0';
+     w_mem(w, tmp + sizeof(tmp) - n, (size_t)n);
+ }
+ #endif
+ 
+ /* For the lines that are printed once per report, not once per block */
+ __attribute__((format(printf, 2, 3)))
+ static void w_printf(LtWriter* w, const char* fmt, ...) {
+     va_list ap;
+     va_start(ap, fmt);
+     int n = vsnprintf(w->buf + w->len, w->cap - w->len, fmt, ap);
+     va_end(ap);
+     if (n >= 0 && (size_t)n >= w->cap - w->len) {
+         // Did not fit: start on an empty buffer (cut if it is still too long)
+         w_flush(w);
+         va_start(ap, fmt);
+         n = vsnprintf(w->buf, w->cap, fmt, ap);
+         va_end(ap);
+         if (n >= 0 && (size_t)n >= w->cap) {
+             n = (int)w->cap - 1;
+         }
+     }
+     if (n > 0) {
+         w->len += (size_t)n;
+     }
+ }
+ 
+ /* Copy a path pattern to dst with every "%p" replaced by the pid */
+ static void expand_pid(char* dst, size_t cap, const char* pattern) {
+     size_t n = 0;
+     for (const char* c = pattern; *c && n < cap - 12; c++) {
+         if (c[0] == '%' && c[1] == 'p') {
+             n += (size_t)snprintf(dst + n, cap - n, "%d", (int)getpid());
+             c++;
+         } else {
+             dst[n++] = *c;
+         }
+     }
+     dst[n] = '\0';
+ }
+ 
+ /* Serializes the lists and counters above between threads */
+ static pthread_mutex_t tracker_lock = PTHREAD_MUTEX_INITIALIZER;
+ 
+ /* ----- Fast-path state (see leak_tracker.h) ----- */
+ 
+ __thread lt_thread_state lt_tls;
+ unsigned      lt_config_gen = 1;               // fresh threads (gen 0) start on the slow path
+ unsigned char lt_free_fast  = !LEAK_TRACKER_TRACK;
+ unsigned char lt_count_usable = 0;                     // mode=count
+ unsigned char lt_filter[1u << LT_FILTER_BITS];
+ 
+ static unsigned long    sample_interval    = 1;     // track one allocation in this many
+ 
+ /* What the slow path records (LEAK_TRACKER_OPTIONS mode=, apply_mode) */
+ #if LEAK_TRACKER_TRACK
+ static int              tracking_mode      = LT_MODE_FULL;   // in effect, after throttling
+ static int              base_mode          = LT_MODE_FULL;   // asked for
+ static unsigned long    base_interval      = 1;
+ static int              untracked_frees_ok = 0;     // set while a cheaper mode is in effect
+ static unsigned long    sample_rate        = 64;    // interval of LT_MODE_SAMPLE
+ static size_t           mode_switches      = 0;     // after the first allocation
+ static size_t           mode_switch_allocs = 0;     // allocations before the last one
+ 
+ /*
+  * Switching modes from outside the process: each mode_signal moves one
+  * step count -> sample -> full -> count. The handler only counts; the next
+  * slow path of any thread (bumping lt_config_gen sends them all there)
+  * applies it under the lock. The control file is polled by a thread.
+  */
+ static unsigned         mode_signals       = 0;     // received, not yet applied
+ static int              mode_signal_number = 0;
+ static char             control_path[1024];
+ static int              control_running    = 0;     // the poll thread exists
+ 
+ /* Overhead controller (LEAK_TRACKER_OPTIONS overhead=, tracker_set_overhead_budget) */
+ #if defined(CLOCK_MONOTONIC_COARSE)
+ #define OVERHEAD_CLOCK       CLOCK_MONOTONIC_COARSE
+ #else
+ #define OVERHEAD_CLOCK       CLOCK_MONOTONIC
+ #endif
+ #define OVERHEAD_WINDOW_NS   100000000u     // 100 ms
+ #define OVERHEAD_MAX_SHIFT   20             // sample at most 2^20 times more sparsely
+ #define OVERHEAD_EVERY_SHIFT 4              // time one slow path in 16 when not throttled
+ static unsigned char    overhead_on           = 0;
+ static double           overhead_budget       = 0;     // fraction of the threads' time
+ static double           overhead_share        = 0;     // measured in the last window
+ static int              overhead_shift        = 0;     // sampling throttled by 2^shift
+ static int              overhead_peak_shift   = 0;
+ static unsigned         overhead_every        = 1u << OVERHEAD_EVERY_SHIFT;
+ static uint64_t         overhead_ticks_sum    = 0;     // this window, scaled
+ static unsigned         overhead_threads      = 0;     // threads measured this window
+ static unsigned         overhead_window       = 1;
+ static uint64_t         overhead_window_ns    = 0;
+ static uint64_t         overhead_window_ticks = 0;
+ static __thread unsigned overhead_countdown   = 1;
+ static __thread unsigned overhead_scale       = 1;
+ static __thread unsigned overhead_thread_window = 0;
+ 
+ /* The cycle counter, or a nanosecond clock where there is none */
+ static inline uint64_t overhead_ticks(void) {
+ #if defined(__x86_64__) || defined(__i386__)
+     return __builtin_ia32_rdtsc();
+ #elif defined(__aarch64__)
+     uint64_t v;
+     __asm__ volatile("mrs %0, cntvct_el0" : "=r"(v));
+     return v;
+ #else
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+ #endif
+ }
+ 
+ static const char* mode_name(int mode) {
+     return mode == LT_MODE_COUNT ? "count" : mode == LT_MODE_SAMPLE ? "sample" : "full";
+ }
+ 
+ /*
+  * Quarantine: freed tracked blocks are held back from libc, oldest out
+  * first, until they add up to more than quarantine_limit bytes. Their
+  * addresses cannot be handed out again meanwhile, so a second free of
+  * one is always caught as a double free.
+  */
+ typedef struct QuarantineEntry {
+     void*  ptr;
+     size_t size;
+ } QuarantineEntry;
+ #define QUARANTINE_SLOTS 65536
+ static QuarantineEntry* quarantine       = NULL;   // ring, mapped on first use
+ static size_t           quarantine_limit = 0;      // bytes, 0 = off
+ static size_t           quarantine_bytes = 0;
+ static size_t           quarantine_head  = 0;      // oldest entry
+ static size_t           quarantine_count = 0;
+ 
+ /*
+  * Addresses of the freed records kept for double-free reports, oldest
+  * first. Past FREED_SLOTS the oldest record is dropped, so the history
+  * stays bounded however many addresses the program goes through. It is
+  * twice the quarantine ring, so a quarantined block keeps its record.
+  */
+ #define FREED_SLOTS (2 * QUARANTINE_SLOTS)
+ static void**           freed_ring  = NULL;        // mapped on first use
+ static size_t           freed_head  = 0;           // oldest entry
+ static size_t           freed_count = 0;
+ #endif
+ #if LEAK_TRACKER_STACKS
+ static int              stack_depth        = LEAK_TRACKER_STACK_DEPTH;   // frames to keep
+ #endif
+ 
+ /* Exit report detail (LEAK_TRACKER_OPTIONS report=) */
+ enum { REPORT_NONE, REPORT_SUMMARY, REPORT_FULL };
+ static int              report_detail      = REPORT_FULL;
+ static lt_thread_state* thread_list        = NULL;  // threads that reached the slow path
+ static pthread_key_t    thread_key;                 // destructor folds exiting threads
+ static __thread uint64_t sample_rng;
+ 
+ /* The section is walked as an array, so no padding may sneak in between sites */
+ _Static_assert(sizeof(lt_site) == 128, "lt_site must stay 128 bytes");
+ 
+ /* lt_sites sections of the modules loaded so far, in registration order */
+ #define MAX_SITE_MODULES 64
+ typedef struct SiteRange {
+     lt_site* begin;
+     lt_site* end;
+ } SiteRange;
+ static SiteRange site_ranges[MAX_SITE_MODULES];
+ static int       site_range_count = 0;
+ static unsigned  site_count       = 0;
+ 
+ /* Fault injection: which allocations to fail, and a log of those that were */
+ #define MAX_FAULT_RULES   16
+ #define MAX_FAULT_LOG     64
+ typedef struct FaultRule {
+     char     file[128];  // site pattern, as for budgets
+     int      line;
+     double   p;          // failure probability per matching allocation
+     uint64_t seed;
+     uint64_t rng;        // xorshift64 state, restarted from seed
+ } FaultRule;
+ 
+ static FaultRule         fault_rules[MAX_FAULT_RULES];
+ static int               fault_rule_count = 0;
+ static unsigned long     fault_seq        = 0;  // allocations seen while injection is on
+ static unsigned long     fault_nth        = 0;  // fail when fault_seq reaches this, 0 = off
+ static int               faults_active    = 0;  // any rule set: no sampling
+ static tracker_injection fault_log[MAX_FAULT_LOG];
+ static size_t            fault_count      = 0;  // injected failures (may exceed the log)
+ 
+ /* Fast-path counts of threads that have already exited */
+ static size_t retired_alloc_calls      = 0;
+ static size_t retired_free_calls       = 0;
+ static size_t retired_bytes_allocated  = 0;
+ static size_t retired_usable_allocated = 0;
+ static size_t retired_usable_freed     = 0;
+ static size_t usable_base              = 0;   // usable_live() when count mode was last entered
+ 
+ /* fork(): set in parent and child, so their reports carry the pid */
+ static int    has_forked   = 0;
+ static pid_t  parent_pid   = 0;    // in a child: the process it was forked from
+ #endif
+  
+ /* ----- Hardware counter instrumentation (build with -DLEAK_TRACKER_PERF) ----- */
+ 
+ #ifdef LEAK_TRACKER_PERF
+ #include <errno.h>
+ #include <stdint.h>
+ #include <unistd.h>
+ #include <sys/ioctl.h>
+ #include <sys/syscall.h>
+ #include <linux/perf_event.h>
+ 
+ enum { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_CACHE_MISSES, PERF_BRANCH_MISSES, PERF_NUM_EVENTS };
+ enum { PERF_OP_ALLOC, PERF_OP_REALLOC, PERF_OP_FREE, PERF_NUM_OPS };
+ 
+ static const char* const perf_event_names[PERF_NUM_EVENTS] = {
+     "cycles", "instructions", "cache-misses", "branch-misses"
+ };
+ static const unsigned long long perf_event_configs[PERF_NUM_EVENTS] = {
+     PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+     PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+ };
+ static const char* const perf_op_names[PERF_NUM_OPS] = {
+     "malloc/calloc", "realloc", "free"
+ };
+ 
+ /* One bookkeeping measurement; realloc accumulates two spans into one op */
+ typedef struct PerfSpan {
+     uint64_t start[PERF_NUM_EVENTS];
+     uint64_t sum[PERF_NUM_EVENTS];
+     uint64_t start_running;   // group time_running at span start
+     int      invalid;         // set once any span could not be measured
+ } PerfSpan;
+ 
+ /* Counters are per thread (perf_event_open with pid = 0), totals are shared */
+ static __thread int      perf_state = 0;          // 0 = not opened, 1 = active, -1 = unavailable
+ static __thread int      perf_group_fd = -1;      // group leader
+ static __thread int      perf_slot[PERF_NUM_EVENTS];   // index in the group read, -1 if missing
+ static __thread int      perf_fd[PERF_NUM_EVENTS];     // -1 if missing; closed at thread exit
+ static __thread int      perf_nr_open = 0;
+ static __thread uint64_t perf_baseline[PERF_NUM_EVENTS];  // cost of an empty begin/end pair
+ static int      perf_error = 0;                   // errno of the failed perf_event_open
+ static int      perf_ever_opened = 0;             // some thread got a working group
+ static int      perf_event_seen[PERF_NUM_EVENTS]; // event opened in at least one thread
+ static uint64_t perf_totals[PERF_NUM_OPS][PERF_NUM_EVENTS];
+ static size_t   perf_measured[PERF_NUM_OPS];      // ops included in the averages
+ static size_t   perf_skipped[PERF_NUM_OPS];       // ops dropped because of multiplexing
+ 
+ static int  perf_read(uint64_t out[PERF_NUM_EVENTS], uint64_t* running);
+ static void perf_span_begin(PerfSpan* s);
+ static void perf_span_end(PerfSpan* s);
+ static void perf_report(void);
+ 
+ static int perf_open_event(unsigned long long config, int group_fd) {
+     struct perf_event_attr attr;
+     memset(&attr, 0, sizeof(attr));
+     attr.type           = PERF_TYPE_HARDWARE;
+     attr.size           = sizeof(attr);
+     attr.config         = config;
+     attr.disabled       = (group_fd == -1);
+     attr.exclude_kernel = 1;
+     attr.exclude_hv     = 1;
+     attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_RUNNING;
+     return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+ }
+ 
+ /*
+  * Open the counter group on first use. The first event that opens becomes
+  * the leader; events the PMU does not support are left out and reported as n/a.
+  */
+ static void perf_init(void) {
+     perf_state = -1;
+     for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+         perf_slot[i] = -1;
+         int fd = perf_open_event(perf_event_configs[i], perf_group_fd);
+         perf_fd[i] = fd;
+         if (fd < 0) {
+             if (!perf_error) {
+                 perf_error = errno;
+             }
+             continue;
+         }
+         if (perf_group_fd == -1) {
+             perf_group_fd = fd;
+         }
+         perf_slot[i] = perf_nr_open++;
+         perf_event_seen[i] = 1;
+     }
+     if (perf_group_fd == -1) {
+         return;
+     }
+     ioctl(perf_group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+     ioctl(perf_group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+     perf_state = 1;
+     perf_ever_opened = 1;
+ 
+     // Calibrate the cost of the measurement itself so it can be subtracted
+     for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+         perf_baseline[i] = UINT64_MAX;
+     }
+     for (int rep = 0; rep < 32; rep++) {
+         PerfSpan s;
+         memset(&s, 0, sizeof(s));
+         perf_span_begin(&s);
+         perf_span_end(&s);
+         for (int i = 0; !s.invalid && i < PERF_NUM_EVENTS; i++) {
+             if (s.sum[i] < perf_baseline[i]) {
+                 perf_baseline[i] = s.sum[i];
+             }
+         }
+     }
+     for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+         if (perf_baseline[i] == UINT64_MAX) {
+             perf_baseline[i] = 0;
+         }
+     }
+ }
+ 
+ /* Thread exit: close the thread's group; it is not reopened */
+ static void perf_close(void) {
+     if (perf_state == 1) {
+         for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+             if (perf_fd[i] >= 0) {
+                 close(perf_fd[i]);
+             }
+         }
+         perf_group_fd = -1;
+     }
+     perf_state = -1;
+ }
+ 
+ /* Read all counters of the group with a single syscall */
+ static int perf_read(uint64_t out[PERF_NUM_EVENTS], uint64_t* running) {
+     uint64_t buf[2 + PERF_NUM_EVENTS];   // nr, time_running, values...
+     if (read(perf_group_fd, buf, sizeof(buf)) < (ssize_t)(2 * sizeof(uint64_t))) {
+         return 0;
+     }
+     *running = buf[1];
+     for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+         out[i] = (perf_slot[i] >= 0) ? buf[2 + perf_slot[i]] : 0;
+     }
+     return 1;
+ }
+ 
+ static void perf_span_begin(PerfSpan* s) {
+     if (perf_state == 0) {
+         perf_init();
+     }
+     if (perf_state != 1 || !perf_read(s->start, &s->start_running)) {
+         s->invalid = 1;
+     }
+ }
+ 
+ /* Add the counter deltas since perf_span_begin() to the span */
+ static void perf_span_end(PerfSpan* s) {
+     uint64_t now[PERF_NUM_EVENTS];
+     uint64_t running;
+     if (s->invalid || !perf_read(now, &running) || running == s->start_running) {
+         // Group was not scheduled on the PMU for this span: counts are meaningless
+         s->invalid = 1;
+         return;
+     }
+     for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+         s->sum[i] += now[i] - s->start[i];
+     }
+ }
+ 
+ /* Fold a finished measurement into the per-operation totals */
+ static void perf_commit(int op, const PerfSpan* s, int nspans) {
+     if (perf_state != 1) {
+         return;
+     }
+     if (s->invalid) {
+         perf_skipped[op]++;
+         return;
+     }
+     for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+         uint64_t bias = perf_baseline[i] * (uint64_t)nspans;
+         perf_totals[op][i] += (s->sum[i] > bias) ? s->sum[i] - bias : 0;
+     }
+     perf_measured[op]++;
+ }
+ 
+ /* Print per-operation averages; called from leak_report() */
+ static void perf_report(void) {
+     w_printf(&report_out, "\n----- Tracker hot-path counters (per operation) -----\n");
+     if (!perf_ever_opened) {
+         w_printf(&report_out, "Hardware counters unavailable (%s); no measurements taken.\n",
+                perf_error ? strerror(perf_error) : "no tracked operations");
+         return;
+     }
+     w_printf(&report_out, "%-14s %10s", "Operation", "count");
+     for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+         w_printf(&report_out, " %14s", perf_event_names[i]);
+     }
+     w_printf(&report_out, "\n");
+     for (int op = 0; op < PERF_NUM_OPS; op++) {
+         w_printf(&report_out, "%-14s %10zu", perf_op_names[op], perf_measured[op]);
+         for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+             if (!perf_event_seen[i] || perf_measured[op] == 0) {
+                 w_printf(&report_out, " %14s", "n/a");
+             } else {
+                 w_printf(&report_out, " %14.1f", (double)perf_totals[op][i] / (double)perf_measured[op]);
+             }
+         }
+         w_printf(&report_out, "\n");
+     }
+     for (int op = 0; op < PERF_NUM_OPS; op++) {
+         if (perf_skipped[op]) {
+             w_printf(&report_out, "(%zu %s operation(s) skipped: counters were multiplexed out)\n",
+                    perf_skipped[op], perf_op_names[op]);
+         }
+     }
+ }
+ 
+ #define PERF_SPAN(s)           PerfSpan s = { .invalid = 0 }
+ #define PERF_BEGIN(s)          perf_span_begin(&(s))
+ #define PERF_END(s)            perf_span_end(&(s))
+ #define PERF_COMMIT(s, op, n)  perf_commit((op), &(s), (n))
+ #else
+ #define PERF_SPAN(s)           do { } while (0)
+ #define PERF_BEGIN(s)          do { } while (0)
+ #define PERF_END(s)            do { } while (0)
+ #define PERF_COMMIT(s, op, n)  do { } while (0)
+ #endif /* LEAK_TRACKER_PERF */
+ 
+ #if LEAK_TRACKER_ENABLED
+ /* Forward declarations */
+ static void   register_leak_report(void);
+ static void   leak_report(void);
+ static void   crash_stack_check(void);
+ static void   crash_stack_release(void);
+ #endif
+ #if LEAK_TRACKER_TRACK
+ static void   record_allocation(void* ptr, size_t size, lt_site* site);
+ static int    remove_allocation_node(void* ptr, AllocInfo* out);
+ static int    is_in_freed_list(void* ptr);
+ static void   add_to_freed_list(void* ptr, lt_site* alloc_site, const lt_site* free_site);
+ static void   remove_from_freed_list(void* ptr);
+ static void   budget_bind(lt_site* begin, lt_site* end);
+ static void   thread_retire(unsigned id);
+ static void   fork_child_epoch(void);
+ static void   meta_fork_prepare(void);
+ static void   meta_fork_parent(void);
+ static void   meta_fork_child(void);
+ static void   meta_add_sites(const lt_site* begin, const lt_site* end);
+ static void   meta_sync(void);
+ static int    meta_open(void);
+ static void   meta_close(void);
+ static void   apply_mode(int mode, unsigned long interval);
+ static void   mode_requests(void);
+ static int    control_start(void);
+ static int    mode_signal_install(int sig);
+ #endif
+ 
+ #if LEAK_TRACKER_ENABLED
+ /* On the first slow path, so a program that never allocates prints nothing; lock held */
+ static void register_leak_report(void) {
+     if (!atexit_registered) {
+         atexit(leak_report);
+         atexit_registered = 1;
+     }
+ }
+ 
+ /* ----- Per-site count batches (lt_site_batch in leak_tracker.h) ----- */
+ 
+ static void batch_lock(lt_thread_state* t) {
+     while (__atomic_exchange_n(&t->batch_lock, 1, __ATOMIC_ACQUIRE)) {
+     }
+ }
+ 
+ static void batch_unlock(lt_thread_state* t) {
+     __atomic_store_n(&t->batch_lock, 0, __ATOMIC_RELEASE);
+ }
+ 
+ /* Add what slot b counted since the last move to its site; batch_lock held */
+ static void batch_move(lt_site_batch* b) {
+     if (!b->site) {
+         return;
+     }
+     size_t calls  = __atomic_load_n(&b->calls, __ATOMIC_RELAXED);
+     size_t bytes  = __atomic_load_n(&b->bytes, __ATOMIC_RELAXED);
+     size_t usable = __atomic_load_n(&b->usable_bytes, __ATOMIC_RELAXED);
+     __atomic_fetch_add(&b->site->calls, calls - b->calls_done, __ATOMIC_RELAXED);
+     __atomic_fetch_add(&b->site->bytes, bytes - b->bytes_done, __ATOMIC_RELAXED);
+     __atomic_fetch_add(&b->site->usable_bytes, usable - b->usable_done, __ATOMIC_RELAXED);
+     b->calls_done  = calls;
+     b->bytes_done  = bytes;
+     b->usable_done = usable;
+ }
+ 
+ static void batch_move_all(lt_thread_state* t) {
+     batch_lock(t);
+     for (int i = 0; i < LT_SITE_BATCH; i++) {
+         batch_move(&t->batch[i]);
+     }
+     batch_unlock(t);
+ }
+ 
+ /* Fast path: the calling thread's slot b is taken by another site */
+ void lt_site_switch(lt_site_batch* b, lt_site* site) {
+     lt_thread_state* t = &lt_tls;
+     batch_lock(t);
+     batch_move(b);
+     memset(b, 0, sizeof(*b));
+     b->site = site;
+     batch_unlock(t);
+ }
+ 
+ /* Bring every site's counters up to date before they are read; lock held */
+ static void site_counts_sync(void) {
+     for (lt_thread_state* t = thread_list; t; t = t->next) {
+         batch_move_all(t);
+     }
+ }
+ 
+ /* Thread exit: keep its fast-path counts and drop it from the registry */
+ static void thread_exit(void* arg) {
+     lt_thread_state* t = (lt_thread_state*)arg;
+     pthread_mutex_lock(&tracker_lock);
+     batch_move_all(t);
+     retired_alloc_calls     += t->alloc_calls;
+     retired_free_calls      += t->free_calls;
+     retired_bytes_allocated += t->bytes_allocated;
+     retired_usable_allocated += t->usable_allocated;
+     retired_usable_freed     += t->usable_freed;
+     for (lt_thread_state** pp = &thread_list; *pp; pp = &(*pp)->next) {
+         if (*pp == t) {
+             *pp = t->next;
+             break;
+         }
+     }
+ #if LEAK_TRACKER_TRACK
+     thread_retire(thread_index);
+ #endif
+     pthread_mutex_unlock(&tracker_lock);
+     crash_stack_release();
+ #ifdef LEAK_TRACKER_PERF
+     perf_close();
+ #endif
+ }
+ 
+ /*
+  * Called by every translation unit's constructor with its module's
+  * lt_sites bounds; a module is added once and its sites get their ids.
+  */
+ void lt_register_sites(lt_site* begin, lt_site* end) {
+     if (!begin || begin == end) {
+         return;
+     }
+     pthread_mutex_lock(&tracker_lock);
+     int known = 0;
+     for (int i = 0; i < site_range_count; i++) {
+         if (site_ranges[i].begin == begin) {
+             known = 1;
+             break;
+         }
+     }
+     if (!known && site_range_count == MAX_SITE_MODULES) {
+         fprintf(stderr, "leak_tracker WARNING: more than %d modules, call sites of %p not listed\n",
+                 MAX_SITE_MODULES, (void*)begin);
+     } else if (!known) {
+         site_ranges[site_range_count].begin = begin;
+         site_ranges[site_range_count].end   = end;
+         site_range_count++;
+         for (lt_site* s = begin; s < end; s++) {
+             s->id = ++site_count;
+         }
+ #if LEAK_TRACKER_TRACK
+         budget_bind(begin, end);
+         meta_add_sites(begin, end);
+ #endif
+     }
+     pthread_mutex_unlock(&tracker_lock);
+ }
+ 
+ #if LEAK_TRACKER_TRACK
+ /* Site with the given id (ids run consecutively through the modules), or NULL */
+ static const lt_site* site_by_id(unsigned id) {
+     unsigned first = 1;
+     for (int r = 0; r < site_range_count && id; r++) {
+         unsigned n = (unsigned)(site_ranges[r].end - site_ranges[r].begin);
+         if (id < first + n) {
+             return &site_ranges[r].begin[id - first];
+         }
+         first += n;
+     }
+     return NULL;
+ }
+ #endif
+ 
+ /*
+  * Site pattern used by budgets and fault rules: 'file' is the whole path
+  * or a tail of it after a '/', 'line' 0 matches every line.
+  */
+ static int site_matches(const char* file, int line, const lt_site* site) {
+     if (line && line != site->line) {
+         return 0;
+     }
+     size_t flen = strlen(site->file);
+     size_t plen = strlen(file);
+     if (plen > flen || strcmp(site->file + flen - plen, file) != 0) {
+         return 0;
+     }
+     return plen == flen || site->file[flen - plen - 1] == '/';
+ }
+ 
+ static const char* const site_kind_names[] = { "malloc", "calloc", "realloc", "free" };
+ 
+ /*
+  * Called on the slow path of every allocation while a fault rule is set.
+  * Returns 1 (errno = ENOMEM) if this allocation is to fail. Each failure
+  * is logged with the allocation's sequence number and the rule that fired
+  * (0 = the Nth-allocation rule, k = pattern rule k), and announced on
+  * stderr at once so a crash that follows can still be replayed.
+  */
+ static int fault_inject(const lt_site* site, size_t size) {
+     int rule = -1;
+     pthread_mutex_lock(&tracker_lock);
+     unsigned long seq = ++fault_seq;
+     if (fault_nth && seq == fault_nth) {
+         rule = 0;
+     }
+     for (int i = 0; rule < 0 && i < fault_rule_count; i++) {
+         FaultRule* r = &fault_rules[i];
+         if (!site_matches(r->file, r->line, site)) {
+             continue;
+         }
+         r->rng ^= r->rng << 13;
+         r->rng ^= r->rng >> 7;
+         r->rng ^= r->rng << 17;
+         if ((double)(r->rng >> 11) * 0x1.0p-53 < r->p) {
+             rule = i + 1;
+         }
+     }
+     if (rule >= 0) {
+         if (fault_count < MAX_FAULT_LOG) {
+             tracker_injection* e = &fault_log[fault_count];
+             e->seq  = seq;
+             e->site = site;
+             e->size = size;
+             e->rule = rule;
+         }
+         fault_count++;
+     }
+     pthread_mutex_unlock(&tracker_lock);
+     if (rule < 0) {
+         return 0;
+     }
+     fprintf(stderr,
+             "leak_tracker: injected failure of %zu-byte %s at %s:%d "
+             "(allocation %lu, rule %d)\n",
+             size, site_kind_names[site->kind], site->file, site->line, seq, rule);
+     errno = ENOMEM;
+     return 1;
+ }
+ 
+ /*
+  * fork() handlers. The forking thread holds tracker_lock across the fork,
+  * so the child never copies a half-updated table. The child then starts
+  * a new epoch: it is the only thread left, its counters restart at zero,
+  * and blocks the parent allocated stay tracked (so freeing them is legal)
+  * but are not reported as the child's leaks.
+  */
+ static void fork_prepare(void) {
+     pthread_mutex_lock(&tracker_lock);
+ #if LEAK_TRACKER_TRACK
+     meta_fork_prepare();
+ #endif
+ }
+ 
+ static void fork_parent(void) {
+     has_forked = 1;
+ #if LEAK_TRACKER_TRACK
+     meta_fork_parent();
+ #endif
+     pthread_mutex_unlock(&tracker_lock);
+ }
+ 
+ static void fork_child(void) {
+     pthread_mutex_init(&tracker_lock, NULL);
+ #if LEAK_TRACKER_TRACK
+     meta_fork_child();
+ #endif
+     has_forked = 1;
+     parent_pid = getppid();
+     // The other threads did not survive the fork
+     thread_list = NULL;
+     if (lt_tls.gen) {
+         lt_tls.next = NULL;
+         thread_list = &lt_tls;
+     }
+     // The usable-size totals are a balance, not a count: blocks inherited
+     // from the parent may still be freed here, so they carry over
+     lt_tls.alloc_calls = lt_tls.free_calls = lt_tls.bytes_allocated = 0;
+     lt_tls.batch_lock = 0;
+     for (int i = 0; i < LT_SITE_BATCH; i++) {
+         lt_tls.batch[i].calls_done = lt_tls.batch[i].calls;
+         lt_tls.batch[i].bytes_done = lt_tls.batch[i].bytes;
+     }
+     retired_alloc_calls = retired_free_calls = retired_bytes_allocated = 0;
+ #if LEAK_TRACKER_COUNT
+     total_alloc_calls = total_free_calls = total_bytes_allocated = 0;
+ #endif
+     for (int r = 0; r < site_range_count; r++) {
+         for (lt_site* s = site_ranges[r].begin; s < site_ranges[r].end; s++) {
+             s->calls = s->bytes = 0;
+             s->tracked_blocks -= s->freed_blocks;
+             s->freed_blocks = 0;
+         }
+     }
+     fault_count = 0;
+ #if LEAK_TRACKER_TRACK
+     fork_child_epoch();
+     // No thread may be started here; the next slow path restarts the poller
+     if (control_running) {
+         control_running = 0;
+         __atomic_add_fetch(&lt_config_gen, 1, __ATOMIC_RELAXED);
+     }
+ #endif
+ }
+ 
+ /*
+  * LEAK_TRACKER_OPTIONS: "key=value" pairs separated by ':' or blanks, in
+  * the style of ASAN_OPTIONS, read once at startup. The string is split in
+  * a static copy, so nothing is allocated before the program starts.
+  *
+  *   mode=count|sample|full     what the tracker records (full)
+  *   sample_rate=N              track one allocation in N; implies mode=sample
+  *   report=full|summary|none   exit report with or without the per-block
+  *                              lines, or none at all (full)
+  *   report_file=PATH           as tracker_set_report_file()
+  *   metadata_file=PATH         as tracker_set_metadata_file()
+  *   quarantine=BYTES           hold freed blocks back from libc, up to this
+  *                              many bytes (k, m, g suffixes) (0)
+  *   stack_depth=N              frames kept per allocation, at most
+  *                              LEAK_TRACKER_STACK_DEPTH
+  *   mode_signal=SIG            USR1, USR2 or a number: each signal moves the
+  *                              mode one step, count -> sample -> full -> count
+  *   control_file=PATH          checked every second; "count", "sample [N]"
+  *                              or "full" in it switches the mode
+  *   overhead=PCT               tracker time budget in percent, held by
+  *                              sampling more sparsely (off)
+  *
+  * Options whose feature is compiled out are ignored with a warning. They
+  * are applied after LEAK_TRACKER_REPORT_FILE and LEAK_TRACKER_METADATA_FILE,
+  * so they win over those.
+  */
+ static char options_buf[1024];
+ 
+ /* Decimal with an optional k/m/g suffix; -1 if malformed */
+ static int parse_size(const char* v, size_t* out) {
+     char* end;
+     errno = 0;
+     unsigned long long n = strtoull(v, &end, 10);
+     if (errno || end == v) {
+         return -1;
+     }
+     switch (*end) {
+     case 'k': case 'K': n <<= 10; end++; break;
+     case 'm': case 'M': n <<= 20; end++; break;
+     case 'g': case 'G': n <<= 30; end++; break;
+     }
+     if (*end) {
+         return -1;
+     }
+     *out = (size_t)n;
+     return 0;
+ }
+ 
+ static void parse_options(const char* env) {
+     size_t len = strlen(env);
+     if (len >= sizeof(options_buf)) {
+         fprintf(stderr, "leak_tracker WARNING: LEAK_TRACKER_OPTIONS longer than %zu bytes, "
+                 "rest ignored\n", sizeof(options_buf) - 1);
+         len = sizeof(options_buf) - 1;
+     }
+     memcpy(options_buf, env, len);
+     options_buf[len] = '\0';
+ 
+     int    mode = -1;
+     size_t rate = 0;
+ #if LEAK_TRACKER_TRACK
+     double overhead_pct = 0;
+ #endif
+     const char* seps = ": \t\n";
+     char* p = options_buf;
+     for (;;) {
+         p += strspn(p, seps);
+         if (!*p) {
+             break;
+         }
+         char* key = p;
+         p += strcspn(p, seps);
+         if (*p) {
+             *p++ = '\0';
+         }
+         char* val = strchr(key, '=');
+         if (!val) {
+             fprintf(stderr, "leak_tracker WARNING: option '%s' has no value\n", key);
+             continue;
+         }
+         *val++ = '\0';
+         size_t n;
+         int ok = 1;
+         if (strcmp(key, "mode") == 0) {
+             mode = strcmp(val, "count")  == 0 ? LT_MODE_COUNT :
+                    strcmp(val, "sample") == 0 ? LT_MODE_SAMPLE :
+                    strcmp(val, "full")   == 0 ? LT_MODE_FULL : -1;
+             ok = mode >= 0;
+         } else if (strcmp(key, "sample_rate") == 0) {
+             ok = parse_size(val, &rate) == 0 && rate > 0;
+         } else if (strcmp(key, "mode_signal") == 0) {
+             const char* name = strncmp(val, "SIG", 3) == 0 ? val + 3 : val;
+             int sig = strcmp(name, "USR1") == 0 ? SIGUSR1 :
+                       strcmp(name, "USR2") == 0 ? SIGUSR2 : atoi(name);
+ #if LEAK_TRACKER_TRACK
+             ok = mode_signal_install(sig) == 0;
+ #else
+             (void)sig;
+             fprintf(stderr, "leak_tracker WARNING: option '%s' needs LEAK_TRACKER_TRACK\n", key);
+ #endif
+         } else if (strcmp(key, "overhead") == 0) {
+             char* end;
+             double pct = strtod(val, &end);
+             ok = end != val && (*end == '\0' || strcmp(end, "%") == 0) && pct >= 0 && pct < 100;
+ #if LEAK_TRACKER_TRACK
+             if (ok) {
+                 overhead_pct = pct;
+             }
+ #else
+             fprintf(stderr, "leak_tracker WARNING: option '%s' needs LEAK_TRACKER_TRACK\n", key);
+ #endif
+         } else if (strcmp(key, "control_file") == 0) {
+ #if LEAK_TRACKER_TRACK
+             size_t len = strlen(val);
+             ok = len > 0 && len < sizeof(control_path);
+             if (ok) {
+                 memcpy(control_path, val, len + 1);
+             }
+ #else
+             fprintf(stderr, "leak_tracker WARNING: option '%s' needs LEAK_TRACKER_TRACK\n", key);
+ #endif
+         } else if (strcmp(key, "report") == 0) {
+             int detail = strcmp(val, "none")    == 0 ? REPORT_NONE :
+                          strcmp(val, "summary") == 0 ? REPORT_SUMMARY :
+                          strcmp(val, "full")    == 0 ? REPORT_FULL : -1;
+             ok = detail >= 0;
+             if (ok) {
+                 report_detail = detail;
+             }
+         } else if (strcmp(key, "report_file") == 0) {
+             tracker_set_report_file(*val ? val : NULL);
+         } else if (strcmp(key, "metadata_file") == 0) {
+ #if LEAK_TRACKER_TRACK
+             tracker_set_metadata_file(*val ? val : NULL);
+ #else
+             fprintf(stderr, "leak_tracker WARNING: option '%s' needs LEAK_TRACKER_TRACK\n", key);
+ #endif
+         } else if (strcmp(key, "quarantine") == 0) {
+             ok = parse_size(val, &n) == 0;
+ #if LEAK_TRACKER_TRACK
+             if (ok) {
+                 quarantine_limit = n;
+             }
+ #else
+             fprintf(stderr, "leak_tracker WARNING: option '%s' needs LEAK_TRACKER_TRACK\n", key);
+ #endif
+         } else if (strcmp(key, "stack_depth") == 0) {
+             ok = parse_size(val, &n) == 0;
+ #if LEAK_TRACKER_STACKS
+             if (ok) {
+                 stack_depth = n < LEAK_TRACKER_STACK_DEPTH ? (int)n : LEAK_TRACKER_STACK_DEPTH;
+             }
+ #else
+             fprintf(stderr, "leak_tracker WARNING: option '%s' needs LEAK_TRACKER_STACKS\n", key);
+ #endif
+         } else {
+             fprintf(stderr, "leak_tracker WARNING: unknown option '%s'\n", key);
+             continue;
+         }
+         if (!ok) {
+             fprintf(stderr, "leak_tracker WARNING: bad value '%s' for option '%s'\n", val, key);
+         }
+     }
+ 
+     if (mode < 0 && rate) {
+         mode = LT_MODE_SAMPLE;
+     }
+ #if LEAK_TRACKER_TRACK
+     pthread_mutex_lock(&tracker_lock);
+     if (rate) {
+         sample_rate = rate;
+     }
+     if (mode >= 0) {
+         apply_mode(mode, sample_rate);
+     }
+     if (control_path[0] && control_start() != 0) {
+         fprintf(stderr, "leak_tracker WARNING: cannot start the control file thread\n");
+     }
+     pthread_mutex_unlock(&tracker_lock);
+     if (overhead_pct > 0) {
+         tracker_set_overhead_budget(overhead_pct);
+     }
+ #else
+     if (mode > LT_MODE_COUNT) {
+         fprintf(stderr, "leak_tracker WARNING: only mode=count is compiled in (LEAK_TRACKER_TRACK=0)\n");
+     } else if (mode == LT_MODE_COUNT) {
+         lt_count_usable = 1;
+     }
+ #endif
+ }
+ 
+ /* Registered at load time so the fast path never has to check for it */
+ __attribute__((constructor))
+ static void tracker_init(void) {
+     pthread_key_create(&thread_key, thread_exit);
+     pthread_atfork(fork_prepare, fork_parent, fork_child);
+     const char* report_path = getenv("LEAK_TRACKER_REPORT_FILE");
+     if (report_path && *report_path) {
+         tracker_set_report_file(report_path);
+     }
+ #if LEAK_TRACKER_TRACK
+     const char* meta_path = getenv("LEAK_TRACKER_METADATA_FILE");
+     if (meta_path && *meta_path) {
+         tracker_set_metadata_file(meta_path);
+     }
+ #endif
+     const char* options = getenv("LEAK_TRACKER_OPTIONS");
+     if (options) {
+         parse_options(options);
+     }
+ }
+ 
+ /*
+  * Common entry of every slow path, called with tracker_lock held: register
+  * the thread on its first visit and re-arm its sampling countdown after an
+  * allocation ('rearm') or a configuration change. The countdown is drawn
+  * uniformly from [1, 2n-1] so its mean is the interval.
+  */
+ static void slow_path_enter(int rearm) {
+     lt_thread_state* t = &lt_tls;
+     if (t->gen == 0) {
+         register_leak_report();
+         t->next     = thread_list;
+         thread_list = t;
+         pthread_setspecific(thread_key, t);
+         sample_rng  = ((uint64_t)(uintptr_t)t << 1) | 1;
+ #if LEAK_TRACKER_TRACK
+         if (free_thread_id_count) {
+             thread_index = free_thread_ids[--free_thread_id_count];
+         } else if (thread_id_seq < LT_MAX_THREADS - 1) {
+             thread_index = ++thread_id_seq;
+         }
+ #endif
+     }
+     crash_stack_check();
+ #if LEAK_TRACKER_TRACK
+     if (LT_UNLIKELY(__atomic_load_n(&mode_signals, __ATOMIC_RELAXED) ||
+                     (control_path[0] && !control_running))) {
+         mode_requests();
+     }
+ #endif
+     if (!rearm && t->gen == lt_config_gen) {
+         return;
+     }
+     t->gen = lt_config_gen;
+     // Budgets and fault rules must see every allocation
+ #if LEAK_TRACKER_TRACK
+     int count_only = tracking_mode == LT_MODE_COUNT;
+     int track_all  = (!count_only && sample_interval <= 1) || budgets_active || faults_active;
+ #else
+     int count_only = 1;
+     int track_all  = faults_active;
+ #endif
+     if (count_only && !track_all) {
+         t->countdown = LONG_MAX;        // nothing to track, count on the thread only
+     } else if (track_all) {
+         t->countdown = 1;
+     } else {
+         sample_rng ^= sample_rng << 13;
+         sample_rng ^= sample_rng >> 7;
+         sample_rng ^= sample_rng << 17;
+         t->countdown = 1 + (long)(sample_rng % (2 * sample_interval - 1));
+     }
+ }
+ 
+ #if LEAK_TRACKER_TRACK
+ /* Whether the slow path records an allocation: budgets need every block */
+ static int slow_path_tracks(void) {
+     return tracking_mode != LT_MODE_COUNT || budgets_active;
+ }
+ #endif
+ 
+ /*
+  * Counting mode, realloc of a block the tracker does not know: the old
+  * block's usable bytes (taken before the call) count as freed, the new
+  * one's as allocated, and the site keeps the net change, modulo 2^64.
+  */
+ static void usable_realloc(lt_site* site, size_t old_usable, void* newptr, size_t size) {
+     if (!__atomic_load_n(&lt_count_usable, __ATOMIC_RELAXED) || (!newptr && size)) {
+         return;                         // failed: the old block stays
+     }
+     size_t new_usable = newptr ? malloc_usable_size(newptr) : 0;
+     lt_site_usable(site, new_usable - old_usable);
+     lt_tls.usable_freed     += old_usable;
+     lt_tls.usable_allocated += new_usable;
+ }
+ 
+ /* Usable bytes allocated minus freed, over all threads, while counted */
+ static size_t usable_total(void) {
+     size_t live = retired_usable_allocated - retired_usable_freed;
+     for (lt_thread_state* t = thread_list; t; t = t->next) {
+         live += t->usable_allocated - t->usable_freed;
+     }
+     return live;
+ }
+ 
+ /* Counting mode: usable bytes still live from the current count period, else 0 */
+ static size_t usable_live(void) {
+     if (!__atomic_load_n(&lt_count_usable, __ATOMIC_RELAXED)) {
+         return 0;
+     }
+     // Blocks from an earlier period freed in this one can take it below 0
+     size_t live = usable_total() - usable_base;
+     return live <= SIZE_MAX / 2 ? live : 0;
+ }
+ 
+ /* Totals of the slow-path counters plus every thread's fast-path counts */
+ static void fold_counters(size_t* allocs, size_t* frees, size_t* bytes) {
+     *allocs = total_alloc_calls + retired_alloc_calls;
+     *frees  = total_free_calls + retired_free_calls;
+     *bytes  = total_bytes_allocated + retired_bytes_allocated;
+     for (lt_thread_state* t = thread_list; t; t = t->next) {
+         *allocs += t->alloc_calls;
+         *frees  += t->free_calls;
+         *bytes  += t->bytes_allocated;
+     }
+ }
+ #endif
+  
+ #if LEAK_TRACKER_REDZONES
+ /* Fill the guard bytes that follow a block of 'size' bytes */
+ static void redzone_fill(void* ptr, size_t size) {
+     memset((unsigned char*)ptr + size, REDZONE_PATTERN, REDZONE_BYTES);
+ }
+ 
+ /*
+  * Verify the guard bytes of a tracked block and warn if they were overwritten.
+  * 'what'/'file'/'line' say where the check happens.
+  */
+ static void redzone_check(const AllocInfo* info, const char* what, const char* file, int line) {
+     const unsigned char* rz = (const unsigned char*)info->ptr + info->size;
+     for (size_t i = 0; i < REDZONE_BYTES; i++) {
+         if (rz[i] != REDZONE_PATTERN) {
+             redzone_overflow_count++;
+             fprintf(stderr,
+                     "leak_tracker WARNING: heap overflow past %zu-byte block %p "
+                     "(allocated at %s:%d), detected at %s %s:%d\n",
+                     info->size, info->ptr, info->site->file, info->site->line, what, file, line);
+             return;
+         }
+     }
+ }
+ #else
+ #define redzone_fill(ptr, size)                   ((void)0)
+ #define redzone_check(info, what, file, line)     ((void)0)
+ #endif /* LEAK_TRACKER_REDZONES */
+ 
+ #if LEAK_TRACKER_TRACK
+ /*
+  * lt_filter counts, per hash slot, the live records and the freed-list
+  * entries. A slot that is zero lets the inline paths skip the lookup.
+  */
+ static void filter_add(void* ptr) {
+     unsigned char* slot = &lt_filter[lt_filter_slot(ptr)];
+     if (*slot < 255) {
+         __atomic_store_n(slot, (unsigned char)(*slot + 1), __ATOMIC_RELAXED);
+     }
+ }
+ 
+ static void filter_remove(void* ptr) {
+     unsigned char* slot = &lt_filter[lt_filter_slot(ptr)];
+     if (*slot < 255) {   // a saturated slot stays on the slow path for good
+         __atomic_store_n(slot, (unsigned char)(*slot - 1), __ATOMIC_RELAXED);
+     }
+ }
+ 
+ /* ----- Block table ----- */
+ 
+ static size_t table_hash(const void* ptr) {
+     uint64_t h = ((uint64_t)(uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15ULL;
+     return (size_t)(h ^ (h >> 29)) & (block_cap - 1);
+ }
+ 
+ /* Slot holding ptr (live or freed), or SIZE_MAX */
+ static size_t table_find(const void* ptr) {
+     if (!block_cap) {
+         return SIZE_MAX;
+     }
+     for (size_t i = table_hash(ptr);; i = (i + 1) & (block_cap - 1)) {
+         if (block_table[i].ptr == ptr) {
+             return i;
+         }
+         if (!block_table[i].ptr) {
+             return SIZE_MAX;
+         }
+     }
+ }
+ 
+ static void* table_map(size_t bytes) {
+     void* mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+     return mem == MAP_FAILED ? NULL : mem;
+ }
+ 
+ /* ----- Metadata file (layout in leak_tracker.h) ----- */
+ 
+ _Static_assert(sizeof(BlockRec) == sizeof(lt_meta_record), "records are stored as is");
+ 
+ #define META_SITE_OFF   4096
+ #define META_SITE_CAP   4096
+ #define META_HEAD_BYTES (META_SITE_OFF + META_SITE_CAP * sizeof(lt_meta_site))
+ 
+ static int             meta_fd       = -1;
+ static lt_meta_header* meta_hdr      = NULL;  // header page and site table
+ static uint64_t        meta_end      = 0;     // file size
+ static uint64_t        meta_new_off  = 0;     // where table_map_records put the last table
+ static char            meta_pattern[1024];    // path as given, "%p" unexpanded
+ 
+ /* Slot array for a table of cap records: in the metadata file when there is one */
+ static BlockRec* table_map_records(size_t cap) {
+     size_t bytes = cap * sizeof(BlockRec);
+     if (meta_fd < 0) {
+         return (BlockRec*)table_map(bytes);
+     }
+     if (ftruncate(meta_fd, (off_t)(meta_end + bytes)) != 0) {
+         return NULL;
+     }
+     void* mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, meta_fd, (off_t)meta_end);
+     if (mem == MAP_FAILED) {
+         return NULL;
+     }
+     meta_new_off = meta_end;
+     meta_end    += bytes;
+     return (BlockRec*)mem;
+ }
+ 
+ /*
+  * The table now lives in the slots from the last table_map_records():
+  * point the header there and give the old slots' disk space back.
+  */
+ static void meta_table_moved(size_t old_cap) {
+     if (!meta_hdr) {
+         return;
+     }
+     uint64_t old_off = meta_hdr->block_off;
+     meta_hdr->epoch++;
+     meta_hdr->block_off  = meta_new_off;
+     meta_hdr->block_cap  = block_cap;
+     meta_hdr->block_used = block_used;
+     meta_hdr->epoch++;
+     if (old_off && old_cap) {
+         fallocate(meta_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                   (off_t)old_off, (off_t)(old_cap * sizeof(BlockRec)));
+     }
+ }
+ 
+ /* Copy the counters the inspector shows; called after every table change */
+ static void meta_sync(void) {
+     if (!meta_hdr) {
+         return;
+     }
+     meta_hdr->block_used      = block_used;
+     meta_hdr->alloc_calls     = total_alloc_calls;
+     meta_hdr->bytes_allocated = total_bytes_allocated;
+     meta_hdr->bytes_freed     = total_bytes_freed;
+     meta_hdr->live_blocks     = live_block_count;
+     meta_hdr->live_bytes      = live_byte_count;
+     meta_hdr->double_frees    = double_free_count;
+     meta_hdr->invalid_frees   = invalid_free_count;
+ }
+ 
+ /* Name the sites of a newly registered module in the file */
+ static void meta_add_sites(const lt_site* begin, const lt_site* end) {
+     if (!meta_hdr) {
+         return;
+     }
+     lt_meta_site* table = (lt_meta_site*)((char*)meta_hdr + META_SITE_OFF);
+     for (const lt_site* s = begin; s < end && meta_hdr->site_count < META_SITE_CAP; s++) {
+         lt_meta_site* m = &table[meta_hdr->site_count];
+         m->addr = (uint64_t)(uintptr_t)s;
+         m->line = (uint32_t)s->line;
+         m->kind = s->kind;
+         snprintf(m->file, sizeof(m->file), "%s", s->file);
+         meta_hdr->site_count++;
+     }
+ }
+ 
+ /* Move the current table into fresh slots (file or anonymous) and drop the old ones */
+ static int meta_move_table(void) {
+     if (!block_cap) {
+         return 0;
+     }
+     BlockRec* table = table_map_records(block_cap);
+     if (!table) {
+         return -1;
+     }
+     memcpy(table, block_table, block_cap * sizeof(BlockRec));
+     munmap(block_table, block_cap * sizeof(BlockRec));
+     block_table = table;
+     meta_table_moved(0);
+     return 0;
+ }
+ 
+ /* Stop using the metadata file: the table goes back to anonymous memory */
+ static void meta_close(void) {
+     if (meta_fd < 0) {
+         return;
+     }
+     munmap(meta_hdr, META_HEAD_BYTES);
+     meta_hdr = NULL;
+     close(meta_fd);
+     meta_fd = -1;
+     meta_move_table();
+ }
+ 
+ /*
+  * Create the metadata file for this process from meta_pattern and move
+  * the table (and the names of all registered sites) into it. -1 on error,
+  * leaving the table where it was.
+  */
+ static int meta_open(void) {
+     char path[sizeof(meta_pattern) + 16];
+     expand_pid(path, sizeof(path), meta_pattern);
+     int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+     if (fd < 0) {
+         fprintf(stderr, "leak_tracker WARNING: cannot create metadata file %s\n", path);
+         return -1;
+     }
+     void* head = MAP_FAILED;
+     if (ftruncate(fd, (off_t)META_HEAD_BYTES) == 0) {
+         head = mmap(NULL, META_HEAD_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+     }
+     if (head == MAP_FAILED) {
+         fprintf(stderr, "leak_tracker WARNING: cannot map metadata file %s\n", path);
+         close(fd);
+         unlink(path);
+         return -1;
+     }
+     meta_close();
+     meta_fd  = fd;
+     meta_hdr = (lt_meta_header*)head;
+     meta_end = META_HEAD_BYTES;
+     memcpy(meta_hdr->magic, LT_META_MAGIC, sizeof(meta_hdr->magic));
+     meta_hdr->version  = LT_META_VERSION;
+     meta_hdr->state    = LT_META_RUNNING;
+     meta_hdr->pid      = (uint64_t)getpid();
+     meta_hdr->site_off = META_SITE_OFF;
+     meta_hdr->site_cap = META_SITE_CAP;
+     for (int r = 0; r < site_range_count; r++) {
+         meta_add_sites(site_ranges[r].begin, site_ranges[r].end);
+     }
+     if (meta_move_table() != 0) {
+         fprintf(stderr, "leak_tracker WARNING: cannot grow metadata file %s\n", path);
+         munmap(meta_hdr, META_HEAD_BYTES);
+         meta_hdr = NULL;
+         close(meta_fd);
+         meta_fd = -1;
+         unlink(path);
+         return -1;
+     }
+     meta_sync();
+     return 0;
+ }
+ 
+ /*
+  * fork() with a metadata file: the mapping would be shared with the
+  * child, so the table is copied while the parent still holds the lock,
+  * and the child continues on that copy (moved into a file of its own if
+  * the pattern has "%p").
+  */
+ static BlockRec* meta_fork_copy = NULL;
+ 
+ static void meta_fork_prepare(void) {
+     if (meta_fd >= 0 && block_cap) {
+         meta_fork_copy = (BlockRec*)table_map(block_cap * sizeof(BlockRec));
+         if (meta_fork_copy) {
+             memcpy(meta_fork_copy, block_table, block_cap * sizeof(BlockRec));
+         }
+     }
+ }
+ 
+ static void meta_fork_parent(void) {
+     if (meta_fork_copy) {
+         munmap(meta_fork_copy, block_cap * sizeof(BlockRec));
+         meta_fork_copy = NULL;
+     }
+ }
+ 
+ static void meta_fork_child(void) {
+     if (meta_fd < 0) {
+         return;
+     }
+     munmap(meta_hdr, META_HEAD_BYTES);
+     meta_hdr = NULL;
+     close(meta_fd);
+     meta_fd = -1;
+     if (meta_fork_copy) {
+         munmap(block_table, block_cap * sizeof(BlockRec));
+         block_table    = meta_fork_copy;
+         meta_fork_copy = NULL;
+     } else {
+         meta_move_table();
+     }
+     if (strstr(meta_pattern, "%p")) {
+         meta_open();
+     }
+ }
+ 
+ /* Double the table (first call: create it); 0 on success */
+ static int table_grow(void) {
+     size_t cap = block_cap ? block_cap * 2 : 1024;
+     BlockRec* table = table_map_records(cap);
+     if (!table) {
+         return -1;
+     }
+ #if LEAK_TRACKER_STACKS
+     BlockStack* stacks = (BlockStack*)table_map(cap * sizeof(BlockStack));
+     if (!stacks) {
+         munmap(table, cap * sizeof(BlockRec));
+         return -1;
+     }
+ #endif
+     BlockRec*   old_table = block_table;
+     size_t      old_cap   = block_cap;
+     block_table = table;
+     block_cap   = cap;
+     for (size_t j = 0; j < old_cap; j++) {
+         if (!old_table[j].ptr) {
+             continue;
+         }
+         size_t i = table_hash(old_table[j].ptr);
+         while (table[i].ptr) {
+             i = (i + 1) & (cap - 1);
+         }
+         table[i] = old_table[j];
+ #if LEAK_TRACKER_STACKS
+         stacks[i] = block_stacks[j];
+ #endif
+     }
+     if (old_table) {
+         munmap(old_table, old_cap * sizeof(BlockRec));
+ #if LEAK_TRACKER_STACKS
+         munmap(block_stacks, old_cap * sizeof(BlockStack));
+ #endif
+     }
+ #if LEAK_TRACKER_STACKS
+     block_stacks = stacks;
+ #endif
+     meta_table_moved(old_cap);
+     return 0;
+ }
+ 
+ /* Claim an empty slot for ptr (known to be absent); SIZE_MAX if out of memory */
+ static size_t table_insert(const void* ptr) {
+     // Keep the load under 70% so probe runs stay short
+     if ((block_used + 1) * 10 > block_cap * 7 && table_grow() != 0) {
+         return SIZE_MAX;
+     }
+     size_t i = table_hash(ptr);
+     while (block_table[i].ptr) {
+         i = (i + 1) & (block_cap - 1);
+     }
+     block_used++;
+     return i;
+ }
+ 
+ /* Empty slot i and shift later members of its probe run back into the gap */
+ static void table_delete(size_t i) {
+     size_t mask = block_cap - 1;
+     size_t gap  = i;
+     for (size_t j = (i + 1) & mask; block_table[j].ptr; j = (j + 1) & mask) {
+         size_t home = table_hash(block_table[j].ptr);
+         // Move j only if its home slot does not lie cyclically in (gap, j]
+         if (((j - home) & mask) >= ((j - gap) & mask)) {
+             block_table[gap] = block_table[j];
+ #if LEAK_TRACKER_STACKS
+             block_stacks[gap] = block_stacks[j];
+ #endif
+             gap = j;
+         }
+     }
+     block_table[gap].ptr = NULL;
+     block_used--;
+ }
+ 
+ static int rec_is_live(const BlockRec* r) {
+     return r->ptr && !(r->meta & REC_FREED);
+ }
+ 
+ static AllocInfo rec_unpack(const BlockRec* r) {
+     AllocInfo info = { r->ptr, REC_SIZE(r), r->site, REC_TAG(r), REC_THREAD(r) };
+     return info;
+ }
+ 
+ /* ----- Address index (tracker_find_block) ----- */
+ 
+ /*
+  * A B+-tree of the live blocks' start addresses, built by the first
+  * tracker_find_block() and kept up to date from then on. Leaves hold the
+  * addresses in order and are chained both ways; an inner node's key[i] is
+  * a lower bound of everything under child[i]. Deletion does not rebalance:
+  * a leaf is dropped once empty, so every leaf but a lone root holds a key
+  * and the last address below any point is found in one descent.
+  */
+ #define BT_FANOUT     32
+ #define BT_RESERVE    16                     // nodes an insert may need, at most
+ #define BT_SLAB_BYTES (1u << 20)
+ typedef struct BtNode {
+     int             count;                   // keys (leaf) or children (inner)
+     int             leaf;
+     struct BtNode*  prev;                    // leaves, in address order
+     struct BtNode*  next;
+     uintptr_t       key[BT_FANOUT];
+     struct BtNode*  child[BT_FANOUT];        // inner nodes only
+ } BtNode;
+ 
+ static BtNode*  bt_root      = NULL;         // NULL until the first query
+ static BtNode*  bt_free      = NULL;         // spare nodes, chained through child[0]
+ static size_t   bt_free_count = 0;
+ static char*    bt_slab      = NULL;         // unused rest of the last mapping
+ static size_t   bt_slab_left = 0;
+ 
+ /* Tops up the spare nodes so that one insert cannot run out midway */
+ static int bt_reserve(void) {
+     while (bt_free_count < BT_RESERVE) {
+         if (bt_slab_left < sizeof(BtNode)) {
+             bt_slab = (char*)table_map(BT_SLAB_BYTES);
+             if (!bt_slab) {
+                 bt_slab_left = 0;
+                 return -1;
+             }
+             bt_slab_left = BT_SLAB_BYTES;
+         }
+         BtNode* n = (BtNode*)bt_slab;
+         bt_slab      += sizeof(BtNode);
+         bt_slab_left -= sizeof(BtNode);
+         n->child[0] = bt_free;
+         bt_free     = n;
+         bt_free_count++;
+     }
+     return 0;
+ }
+ 
+ static BtNode* bt_node(int leaf) {
+     BtNode* n = bt_free;
+     bt_free = n->child[0];
+     bt_free_count--;
+     n->count = 0;
+     n->leaf  = leaf;
+     n->prev  = n->next = NULL;
+     return n;
+ }
+ 
+ static void bt_release(BtNode* n) {
+     n->child[0] = bt_free;
+     bt_free     = n;
+     bt_free_count++;
+ }
+ 
+ /* Last position in n whose key is <= k, or -1 (branch-free: keys are random) */
+ static int bt_floor(const BtNode* n, uintptr_t k) {
+     const uintptr_t* base = n->key;
+     int len = n->count;
+     if (!len) {
+         return -1;
+     }
+     while (len > 1) {
+         int half = len / 2;
+         base = base[half] <= k ? base + half : base;
+         len -= half;
+     }
+     return (int)(base - n->key) - (*base > k);
+ }
+ 
+ /* Puts key (and child, in an inner node) at position i of a node with room */
+ static void bt_put(BtNode* n, int i, uintptr_t key, BtNode* child) {
+     memmove(&n->key[i + 1], &n->key[i], (size_t)(n->count - i) * sizeof(n->key[0]));
+     n->key[i] = key;
+     if (!n->leaf) {
+         memmove(&n->child[i + 1], &n->child[i], (size_t)(n->count - i) * sizeof(n->child[0]));
+         n->child[i] = child;
+     }
+     n->count++;
+ }
+ 
+ /* Inserts k below n; returns the new right half if n had to split */
+ static BtNode* bt_insert(BtNode* n, uintptr_t k) {
+     int i = bt_floor(n, k);
+     BtNode* child = NULL;
+     if (n->leaf) {
+         i++;
+     } else {
+         if (i < 0) {
+             i = 0;
+             n->key[0] = k;                   // k is the new lower bound
+         }
+         child = bt_insert(n->child[i], k);
+         if (!child) {
+             return NULL;
+         }
+         k = child->key[0];
+         i++;
+     }
+     if (n->count < BT_FANOUT) {
+         bt_put(n, i, k, child);
+         return NULL;
+     }
+     // Split in halves, then insert into the half the position falls in
+     int half = BT_FANOUT / 2;
+     BtNode* r = bt_node(n->leaf);
+     memcpy(r->key, &n->key[half], half * sizeof(n->key[0]));
+     if (!n->leaf) {
+         memcpy(r->child, &n->child[half], half * sizeof(n->child[0]));
+     } else {
+         r->next = n->next;
+         r->prev = n;
+         if (n->next) {
+             n->next->prev = r;
+         }
+         n->next = r;
+     }
+     r->count = n->count = half;
+     if (i <= half) {
+         bt_put(n, i, k, child);
+     } else {
+         bt_put(r, i - half, k, child);
+     }
+     return r;
+ }
+ 
+ /* Removes k below n; returns 1 if that left n empty */
+ static int bt_remove(BtNode* n, uintptr_t k) {
+     int i = bt_floor(n, k);
+     if (i < 0) {
+         return 0;
+     }
+     if (n->leaf) {
+         if (n->key[i] != k) {
+             return 0;
+         }
+     } else {
+         if (!bt_remove(n->child[i], k)) {
+             return 0;
+         }
+         bt_release(n->child[i]);
+         memmove(&n->child[i], &n->child[i + 1], (size_t)(n->count - i - 1) * sizeof(n->child[0]));
+     }
+     memmove(&n->key[i], &n->key[i + 1], (size_t)(n->count - i - 1) * sizeof(n->key[0]));
+     if (--n->count || n == bt_root) {
+         return 0;
+     }
+     if (n->leaf) {
+         if (n->prev) {
+             n->prev->next = n->next;
+         }
+         if (n->next) {
+             n->next->prev = n->prev;
+         }
+     }
+     return 1;
+ }
+ 
+ static void bt_drop(BtNode* n) {
+     if (!n->leaf) {
+         for (int i = 0; i < n->count; i++) {
+             bt_drop(n->child[i]);
+         }
+     }
+     bt_release(n);
+ }
+ 
+ /* Index a block that became live; lock held */
+ static void index_add(const void* ptr) {
+     if (bt_reserve() != 0) {
+         // Out of memory: drop the index, the next query rebuilds it
+         bt_drop(bt_root);
+         bt_root = NULL;
+         return;
+     }
+     BtNode* r = bt_insert(bt_root, (uintptr_t)ptr);
+     if (r) {
+         BtNode* root = bt_node(0);
+         root->key[0]   = bt_root->key[0];
+         root->child[0] = bt_root;
+         root->key[1]   = r->key[0];
+         root->child[1] = r;
+         root->count    = 2;
+         bt_root = root;
+     }
+ }
+ 
+ /* Unindex a block that is no longer live; lock held */
+ static void index_remove(const void* ptr) {
+     bt_remove(bt_root, (uintptr_t)ptr);
+     // An inner root left with one child hands over to it, an empty one becomes a leaf
+     while (!bt_root->leaf && bt_root->count <= 1) {
+         BtNode* old = bt_root;
+         if (old->count) {
+             bt_root = old->child[0];
+         } else {
+             old->leaf = 1;
+             break;
+         }
+         bt_release(old);
+     }
+ }
+ 
+ /* Start of the last live block at or below addr, or 0; lock held */
+ static uintptr_t index_floor(uintptr_t addr) {
+     const BtNode* n = bt_root;
+     while (!n->leaf) {
+         int i = bt_floor(n, addr);
+         n = n->child[i < 0 ? 0 : i];
+     }
+     int i = bt_floor(n, addr);
+     if (i >= 0) {
+         return n->key[i];
+     }
+     // Every key here lies above addr: the answer ends the previous leaf
+     return n->prev ? n->prev->key[n->prev->count - 1] : 0;
+ }
+ 
+ /* Insert a new allocation record (never inlined: the stack capture skips its frame) */
+ __attribute__((noinline))
+ static void record_allocation(void* ptr, size_t size, lt_site* site) {
+     // The address may still be remembered as freed: reuse that record
+     size_t i = lt_filter[lt_filter_slot(ptr)] ? table_find(ptr) : SIZE_MAX;
+     if (i != SIZE_MAX && rec_is_live(&block_table[i])) {
+         // Freed behind the tracker's back (real free outside the wrappers)
+         AllocInfo stale;
+         remove_allocation_node(ptr, &stale);
+         i = SIZE_MAX;
+     }
+     if (i == SIZE_MAX) {
+         i = table_insert(ptr);
+         if (i == SIZE_MAX) {
+             fprintf(stderr, "leak_tracker: failed to allocate tracking node\n");
+             return;
+         }
+         // Let frees of this block leave the inline fast path
+         filter_add(ptr);
+     }
+     BlockRec* r = &block_table[i];
+     r->ptr  = ptr;
+     r->site = site;
+     if (bt_root) {
+         index_add(ptr);
+     }
+     r->meta = ((uint64_t)size & REC_SIZE_MASK) | ((uint64_t)current_tag << REC_TAG_SHIFT) |
+               ((uint64_t)thread_index << REC_THREAD_SHIFT);
+ #if LEAK_TRACKER_STACKS
+     {
+         // Skip this function and the slow path that called it
+         void* frames[LEAK_TRACKER_STACK_DEPTH + 2];
+         int n = stack_depth ? backtrace(frames, stack_depth + 2) : 0;
+         BlockStack* st = &block_stacks[i];
+         st->depth = (n > 2) ? n - 2 : 0;
+         memcpy(st->frames, frames + 2, (size_t)st->depth * sizeof(void*));
+     }
+ #endif
+ 
+     total_alloc_calls++;
+     total_bytes_allocated += size;
+     live_block_count++;
+     live_byte_count += size;
+     site->tracked_blocks++;
+     site->live_bytes += size;
+     if (site->budget) {
+         budgets[site->budget - 1].in_use += size;
+     }
+     TagStats* t = &tag_stats[current_tag];
+     t->alloc_calls++;
+     t->bytes_allocated += size;
+     t->live_blocks++;
+     t->live_bytes += size;
+     ThreadStats* th = &thread_stats[thread_index];
+     th->alloc_calls++;
+     th->bytes_allocated += size;
+     th->live_blocks++;
+     th->live_bytes += size;
+     meta_sync();
+ }
+ 
+ /*
+  * Remove the live record for 'ptr'.
+  * If found, copy it to *out, drop it from the table and return 1.
+  * If not found (or only known as freed), return 0.
+  */
+ static int remove_allocation_node(void* ptr, AllocInfo* out) {
+     size_t i = table_find(ptr);
+     if (i == SIZE_MAX || !rec_is_live(&block_table[i])) {
+         return 0;
+     }
+     *out = rec_unpack(&block_table[i]);
+     live_block_count--;
+     live_byte_count -= out->size;
+     out->site->freed_blocks++;
+     out->site->live_bytes -= out->size;
+     if (out->site->budget) {
+         budgets[out->site->budget - 1].in_use -= out->size;
+     }
+     tag_stats[out->tag].live_blocks--;
+     tag_stats[out->tag].live_bytes -= out->size;
+     if (block_table[i].meta & REC_INHERITED) {
+         inherited_blocks--;
+         inherited_bytes -= out->size;
+     }
+     thread_stats[out->thread].live_blocks--;
+     thread_stats[out->thread].live_bytes -= out->size;
+     if (bt_root) {
+         index_remove(ptr);
+     }
+     filter_remove(ptr);
+     table_delete(i);
+     meta_sync();
+     return 1;
+ }
+ 
+ /* Check if ptr is already in the freed list */
+ static int is_in_freed_list(void* ptr) {
+     size_t i = table_find(ptr);
+     return i != SIZE_MAX && (block_table[i].meta & REC_FREED);
+ }
+ 
+ /* Add ptr to freed list (so future frees can be detected as double‐free) */
+ static void add_to_freed_list(void* ptr, lt_site* alloc_site, const lt_site* free_site) {
+     size_t i = table_find(ptr);
+     if (i != SIZE_MAX) {
+         // realloc drops the lock: another thread may have been given the
+         // address already, and its live record must stay
+         if (rec_is_live(&block_table[i])) {
+             return;
+         }
+     } else {
+         if (!freed_ring) {
+             void* m = mmap(NULL, FREED_SLOTS * sizeof(void*), PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+             if (m == MAP_FAILED) {
+                 fprintf(stderr, "leak_tracker: failed to allocate FreedInfo\n");
+                 return;
+             }
+             freed_ring = (void**)m;
+         }
+         if (freed_count == FREED_SLOTS) {
+             // Stale if the address was reused since; if it was freed again
+             // too, this drops the newer record a little early
+             remove_from_freed_list(freed_ring[freed_head]);
+             freed_head = (freed_head + 1) % FREED_SLOTS;
+             freed_count--;
+         }
+         i = table_insert(ptr);
+         if (i == SIZE_MAX) {
+             fprintf(stderr, "leak_tracker: failed to allocate FreedInfo\n");
+             return;
+         }
+         filter_add(ptr);
+         freed_ring[(freed_head + freed_count) % FREED_SLOTS] = ptr;
+         freed_count++;
+     }
+     block_table[i].ptr  = ptr;
+     block_table[i].site = alloc_site;
+     block_table[i].meta = REC_FREED | free_site->id;
+     meta_sync();
+ }
+ 
+ /* Copy the live record for ptr, to put back if the block outlives its removal */
+ static int save_record(const void* ptr, SavedRec* out) {
+     size_t i = table_find(ptr);
+     if (i == SIZE_MAX || !rec_is_live(&block_table[i])) {
+         return 0;
+     }
+     out->rec = block_table[i];
+ #if LEAK_TRACKER_STACKS
+     out->stack = block_stacks[i];
+ #endif
+     return 1;
+ }
+ 
+ /* Undo remove_allocation_node for a block the caller still owns (failed realloc) */
+ static void restore_allocation(const SavedRec* saved) {
+     AllocInfo a = rec_unpack(&saved->rec);
+     size_t i = table_find(a.ptr);
+     if (i == SIZE_MAX) {
+         i = table_insert(a.ptr);
+         if (i == SIZE_MAX) {
+             fprintf(stderr, "leak_tracker: failed to allocate tracking node\n");
+             return;
+         }
+         filter_add(a.ptr);
+     }
+     block_table[i] = saved->rec;
+ #if LEAK_TRACKER_STACKS
+     block_stacks[i] = saved->stack;
+ #endif
+     if (bt_root) {
+         index_add(a.ptr);
+     }
+     live_block_count++;
+     live_byte_count += a.size;
+     a.site->freed_blocks--;
+     a.site->live_bytes += a.size;
+     if (a.site->budget) {
+         budgets[a.site->budget - 1].in_use += a.size;
+     }
+     tag_stats[a.tag].live_blocks++;
+     tag_stats[a.tag].live_bytes += a.size;
+     if (saved->rec.meta & REC_INHERITED) {
+         inherited_blocks++;
+         inherited_bytes += a.size;
+     }
+     thread_stats[a.thread].live_blocks++;
+     thread_stats[a.thread].live_bytes += a.size;
+     meta_sync();
+ }
+ 
+ /*
+  * Hold a freed block in the quarantine (tracker_lock held), releasing the
+  * oldest ones to libc while the total is over the limit. 0 if the caller
+  * should free the block itself: quarantine off, or no room for the ring.
+  */
+ static int quarantine_hold(void* ptr, size_t size) {
+     if (!quarantine_limit) {
+         return 0;
+     }
+     if (!quarantine) {
+         void* m = mmap(NULL, QUARANTINE_SLOTS * sizeof(QuarantineEntry), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+         if (m == MAP_FAILED) {
+             return 0;
+         }
+         quarantine = (QuarantineEntry*)m;
+     }
+     if (quarantine_count == QUARANTINE_SLOTS) {
+         quarantine_bytes -= quarantine[quarantine_head].size;
+         free(quarantine[quarantine_head].ptr);
+         quarantine_head = (quarantine_head + 1) % QUARANTINE_SLOTS;
+         quarantine_count--;
+     }
+     QuarantineEntry* e = &quarantine[(quarantine_head + quarantine_count) % QUARANTINE_SLOTS];
+     e->ptr  = ptr;
+     e->size = size;
+     quarantine_count++;
+     quarantine_bytes += size;
+     while (quarantine_bytes > quarantine_limit && quarantine_count) {
+         quarantine_bytes -= quarantine[quarantine_head].size;
+         free(quarantine[quarantine_head].ptr);
+         quarantine_head = (quarantine_head + 1) % QUARANTINE_SLOTS;
+         quarantine_count--;
+     }
+     return 1;
+ }
+ 
+ /*
+  * A thread is exiting (tracker_lock held): optionally report the blocks it
+  * allocated that are still live, hand them to id 0 and recycle its id.
+  */
+ #define THREAD_EXIT_REPORT_MAX 32
+ static void thread_retire(unsigned id) {
+     ThreadStats* th = &thread_stats[id];
+     if (id == 0) {
+         return;
+     }
+     if (th->live_blocks) {
+         if (thread_exit_reports) {
+             fprintf(stderr,
+                     "leak_tracker WARNING: thread %u exited with %zu block(s) (%zu bytes) "
+                     "it allocated still live:\n", id, th->live_blocks, th->live_bytes);
+         }
+         size_t shown = 0;
+         for (size_t i = 0; i < block_cap; i++) {
+             BlockRec* r = &block_table[i];
+             if (!rec_is_live(r) || REC_THREAD(r) != id) {
+                 continue;
+             }
+             if (thread_exit_reports && shown++ < THREAD_EXIT_REPORT_MAX) {
+                 fprintf(stderr, "  %p: %zu bytes (allocated at %s:%d)\n",
+                         r->ptr, REC_SIZE(r), r->site->file, r->site->line);
+             }
+             r->meta &= ~REC_THREAD_MASK;
+         }
+         if (thread_exit_reports && shown > THREAD_EXIT_REPORT_MAX) {
+             fprintf(stderr, "  ... %zu more\n", shown - THREAD_EXIT_REPORT_MAX);
+         }
+         thread_stats[0].live_blocks += th->live_blocks;
+         thread_stats[0].live_bytes  += th->live_bytes;
+     }
+     memset(th, 0, sizeof(*th));
+     free_thread_ids[free_thread_id_count++] = (unsigned short)id;
+ }
+ 
+ /* Count a block released on another thread than the one that allocated it */
+ static void cross_free_record(const AllocInfo* block) {
+     if (block->thread == thread_index) {
+         return;
+     }
+     cross_free_blocks++;
+     cross_free_bytes += block->size;
+     uintptr_t h = ((uintptr_t)block->site >> 6) * 31 + block->thread * 4099u + thread_index;
+     for (size_t n = 0; n < MAX_CROSS_FREES; n++) {
+         CrossFree* c = &cross_frees[(h + n) & (MAX_CROSS_FREES - 1)];
+         if (!c->site) {
+             if (cross_free_pairs >= MAX_CROSS_FREES * 3 / 4) {
+                 return;
+             }
+             cross_free_pairs++;
+             c->site         = block->site;
+             c->alloc_thread = (unsigned short)block->thread;
+             c->free_thread  = (unsigned short)thread_index;
+         } else if (c->site != block->site || c->alloc_thread != block->thread ||
+                    c->free_thread != thread_index) {
+             continue;
+         }
+         c->blocks++;
+         c->bytes += block->size;
+         return;
+     }
+ }
+ 
+ /*
+  * Child side of fork() (see fork_child): mark every live block as the
+  * parent's, fold the threads that did not survive into id 0 and restart
+  * the cumulative statistics.
+  */
+ static void fork_child_epoch(void) {
+     for (size_t i = 0; i < block_cap; i++) {
+         BlockRec* r = &block_table[i];
+         if (rec_is_live(r)) {
+             r->meta |= REC_INHERITED;
+             if (REC_THREAD(r) != thread_index) {
+                 r->meta &= ~REC_THREAD_MASK;
+             }
+         }
+     }
+     inherited_blocks = live_block_count;
+     inherited_bytes  = live_byte_count;
+     total_bytes_freed = invalid_free_count = double_free_count = budget_denial_count = 0;
+     for (unsigned t = 0; t < LT_MAX_TAGS; t++) {
+         tag_stats[t].alloc_calls = tag_stats[t].bytes_allocated = 0;
+     }
+     for (unsigned id = 1; id <= thread_id_seq; id++) {
+         if (id != thread_index) {
+             thread_stats[0].live_blocks += thread_stats[id].live_blocks;
+             thread_stats[0].live_bytes  += thread_stats[id].live_bytes;
+             memset(&thread_stats[id], 0, sizeof(thread_stats[id]));
+         }
+     }
+     thread_stats[0].alloc_calls = thread_stats[0].bytes_allocated = 0;
+     thread_stats[thread_index].alloc_calls = thread_stats[thread_index].bytes_allocated = 0;
+     thread_id_seq = thread_index;
+     free_thread_id_count = 0;
+     for (unsigned id = 1; id < thread_index; id++) {
+         free_thread_ids[free_thread_id_count++] = (unsigned short)id;
+     }
+     memset(cross_frees, 0, sizeof(cross_frees));
+     cross_free_pairs = cross_free_blocks = cross_free_bytes = 0;
+     memset(site_pairs, 0, sizeof(site_pairs));
+     site_pair_count = site_pair_dropped = 0;
+     meta_sync();
+ }
+ 
+ /* Count a tracked block released at free_site in the ownership map */
+ static void site_pair_record(const AllocInfo* block, lt_site* free_site) {
+     uintptr_t h = ((uintptr_t)block->site >> 6) * 31 + ((uintptr_t)free_site >> 6);
+     for (size_t n = 0; n < MAX_SITE_PAIRS; n++) {
+         SitePair* sp = &site_pairs[(h + n) & (MAX_SITE_PAIRS - 1)];
+         if (!sp->alloc_site) {
+             if (site_pair_count >= MAX_SITE_PAIRS * 3 / 4) {
+                 break;
+             }
+             site_pair_count++;
+             sp->alloc_site = block->site;
+             sp->free_site  = free_site;
+         } else if (sp->alloc_site != block->site || sp->free_site != free_site) {
+             continue;
+         }
+         sp->blocks++;
+         sp->bytes += block->size;
+         return;
+     }
+     site_pair_dropped++;
+ }
+ 
+ /* Forget ptr in the freed list once the allocator hands the address out again */
+ static void remove_from_freed_list(void* ptr) {
+     if (!lt_filter[lt_filter_slot(ptr)]) {
+         return;
+     }
+     size_t i = table_find(ptr);
+     if (i != SIZE_MAX && (block_table[i].meta & REC_FREED)) {
+         table_delete(i);
+         filter_remove(ptr);
+         meta_sync();
+     }
+ }
+ 
+  /*
+  * Classify a pointer that is not in the active list and warn about it.
+  * Returns 1 if it is presumably an allocation that sampling skipped, which
+  * the caller should then pass on to the real allocator.
+  */
+ static int report_bad_free(void* ptr, const char* what, const char* file, int line) {
+     if (is_in_freed_list(ptr)) {
+         const BlockRec* r = &block_table[table_find(ptr)];
+         const lt_site* first = site_by_id(REC_FREE_SITE(r));
+         double_free_count++;
+         fprintf(stderr,
+                 "leak_tracker WARNING: double-free of pointer %p at %s:%d\n",
+                 ptr, file, line);
+         fprintf(stderr, "  allocated at %s:%d, first freed at %s:%d\n",
+                 r->site ? r->site->file : "?", r->site ? r->site->line : 0,
+                 first ? first->file : "?", first ? first->line : 0);
+     } else if (untracked_frees_ok) {
+         return 1;
+     } else {
+         invalid_free_count++;
+         fprintf(stderr,
+                 "leak_tracker WARNING: %s untracked pointer %p at %s:%d\n",
+                 what, ptr, file, line);
+     }
+     meta_sync();
+     return 0;
+ }
+ 
+ /* ----- Allocation budgets ----- */
+ 
+ /* Does 'b' cover the site? Its file matches the whole path or a tail after a '/' */
+ static int budget_matches(const Budget* b, const lt_site* site) {
+     return site_matches(b->file, b->line, site);
+ }
+ 
+ /*
+  * Bind every site in [begin, end) to its most specific budget (a line
+  * budget wins over a file-wide one) and charge its live bytes there.
+  */
+ static void budget_bind(lt_site* begin, lt_site* end) {
+     for (lt_site* s = begin; s < end; s++) {
+         s->budget = 0;
+         for (int i = 0; i < budget_count; i++) {
+             if (budget_matches(&budgets[i], s) &&
+                 (!s->budget || (budgets[i].line && !budgets[s->budget - 1].line))) {
+                 s->budget = (unsigned short)(i + 1);
+             }
+         }
+         if (s->budget) {
+             budgets[s->budget - 1].in_use += s->live_bytes;
+         }
+     }
+ }
+ 
+ /* Recompute all bindings after a budget changed; tracker_lock held */
+ static void budget_rebind(void) {
+     budgets_active = global_budget != 0;
+     for (int i = 0; i < LT_MAX_TAGS; i++) {
+         budgets_active |= tag_stats[i].budget != 0;
+     }
+     for (int i = 0; i < budget_count; i++) {
+         budgets[i].in_use = 0;
+         budgets_active |= budgets[i].limit != 0;
+     }
+     for (int r = 0; r < site_range_count; r++) {
+         budget_bind(site_ranges[r].begin, site_ranges[r].end);
+     }
+     // Threads must leave sampling so every allocation is charged
+     __atomic_add_fetch(&lt_config_gen, 1, __ATOMIC_RELAXED);
+ }
+ 
+ /*
+  * Would 'size' bytes at 'site' go over a cap? A realloc passes the block
+  * it replaces, whose bytes are released at the same time. On a hit the
+  * cap and its current use are returned.
+  */
+ static int budget_exceeded(const lt_site* site, size_t size, const AllocInfo* old,
+                            size_t* limit, size_t* in_use) {
+     size_t old_size = old ? old->size : 0;
+     size_t live = live_byte_count - old_size;
+     if (global_budget && (live > global_budget || size > global_budget - live)) {
+         *limit  = global_budget;
+         *in_use = live;
+         return 1;
+     }
+     if (site->budget) {
+         const Budget* b = &budgets[site->budget - 1];
+         size_t used = b->in_use;
+         if (old && old->site->budget == site->budget) {
+             used -= old_size;
+         }
+         if (b->limit && (used > b->limit || size > b->limit - used)) {
+             *limit  = b->limit;
+             *in_use = used;
+             return 1;
+         }
+     }
+     const TagStats* t = &tag_stats[current_tag];
+     if (t->budget) {
+         size_t used = t->live_bytes - (old && old->tag == current_tag ? old_size : 0);
+         if (used > t->budget || size > t->budget - used) {
+             *limit  = t->budget;
+             *in_use = used;
+             return 1;
+         }
+     }
+     return 0;
+ }
+ 
+ /*
+  * Budget check before the real allocator runs; 1 = go ahead. Over a cap
+  * the handler decides, or the allocation is refused. The handler runs
+  * without the tracker lock, so it may allocate itself.
+  */
+ static int budget_allows(lt_site* site, size_t size, const AllocInfo* old) {
+     size_t limit, in_use;
+     pthread_mutex_lock(&tracker_lock);
+     int over = budget_exceeded(site, size, old, &limit, &in_use);
+     tracker_budget_fn fn = budget_handler;
+     void* ctx = budget_handler_ctx;
+     pthread_mutex_unlock(&tracker_lock);
+     if (!over || (fn && fn(site, size, limit, in_use, ctx))) {
+         return 1;
+     }
+     pthread_mutex_lock(&tracker_lock);
+     budget_denial_count++;
+     pthread_mutex_unlock(&tracker_lock);
+     fprintf(stderr,
+             "leak_tracker WARNING: %zu-byte allocation at %s:%d refused, "
+             "budget %zu bytes with %zu in use\n",
+             size, site->file, site->line, limit, in_use);
+     return 0;
+ }
+ #endif /* LEAK_TRACKER_TRACK */
+ 
+ #if LEAK_TRACKER_ENABLED
+ /* Every registered call site with its counters, whether it leaked or not */
+ static void site_report(void) {
+     if (!site_count) {
+         return;
+     }
+     site_counts_sync();
+     w_printf(&report_out, "\nCall sites:\n");
+     for (int r = 0; r < site_range_count; r++) {
+         for (const lt_site* s = site_ranges[r].begin; s < site_ranges[r].end; s++) {
+             char where[256];
+             snprintf(where, sizeof(where), "%s:%d", s->file, s->line);
+             w_printf(&report_out, "  %-24s %-7s %zu call(s)", where,
+                    s->kind < 4 ? site_kind_names[s->kind] : "?", s->calls);
+             if (s->kind != LT_SITE_FREE) {
+                 w_printf(&report_out, ", %zu byte(s)", s->bytes);
+             }
+             if (lt_count_usable && s->usable_bytes && s->kind != LT_SITE_REALLOC) {
+                 w_printf(&report_out, ", %zu usable byte(s)%s", s->usable_bytes,
+                          s->kind == LT_SITE_FREE ? " released" : "");
+             }
+ #if LEAK_TRACKER_TRACK
+             if (s->tracked_blocks) {
+                 w_printf(&report_out, ", %zu of %zu tracked block(s) live (%zu bytes)",
+                        s->tracked_blocks - s->freed_blocks, s->tracked_blocks, s->live_bytes);
+             }
+ #endif
+             w_printf(&report_out, "\n");
+         }
+     }
+ }
+ 
+ /*
+  * Counting mode has no leak list. What it can show is, per source file,
+  * the usable bytes allocated at the file's sites minus those released at
+  * its free sites. A file whose balance keeps growing is holding memory.
+  * Approximate: a block freed in another file moves its bytes there.
+  */
+ #define BALANCE_REPORT_MAX 20
+ 
+ typedef struct FileBalance {
+     const char* file;
+     long long   bytes;       // allocated - released, usable sizes
+     size_t      allocs;
+     size_t      frees;
+ } FileBalance;
+ 
+ static int cmp_balance(const void* a, const void* b) {
+     long long x = ((const FileBalance*)a)->bytes, y = ((const FileBalance*)b)->bytes;
+     return (x < y) - (x > y);
+ }
+ 
+ static void balance_report(void) {
+     FileBalance* files = site_count ? (FileBalance*)calloc(site_count, sizeof(FileBalance)) : NULL;
+     if (!files) {
+         return;
+     }
+     site_counts_sync();
+     size_t n = 0;
+     for (int r = 0; r < site_range_count; r++) {
+         for (const lt_site* s = site_ranges[r].begin; s < site_ranges[r].end; s++) {
+             // A file's sites are usually adjacent; check the last one first
+             size_t k = n;
+             if (n && strcmp(files[n - 1].file, s->file) == 0) {
+                 k = n - 1;
+             } else {
+                 for (k = 0; k < n && strcmp(files[k].file, s->file) != 0; k++) {
+                 }
+             }
+             if (k == n) {
+                 files[n++].file = s->file;
+             }
+             if (s->kind == LT_SITE_FREE) {
+                 files[k].bytes -= (long long)s->usable_bytes;
+                 files[k].frees += s->calls;
+             } else {
+                 files[k].bytes += (long long)s->usable_bytes;
+                 files[k].allocs += s->calls;
+             }
+         }
+     }
+     qsort(files, n, sizeof(*files), cmp_balance);
+     w_printf(&report_out, "\nBalance by file (usable bytes allocated - released, approximate):\n");
+     size_t shown = 0;
+     for (size_t k = 0; k < n && files[k].bytes > 0; k++) {
+         if (shown++ == BALANCE_REPORT_MAX) {
+             w_printf(&report_out, "  ... more file(s)\n");
+             break;
+         }
+         w_printf(&report_out, "  %-24s %lld byte(s) held, %zu allocation(s), %zu free(s)\n",
+                  files[k].file, files[k].bytes, files[k].allocs, files[k].frees);
+     }
+     if (!shown) {
+         w_printf(&report_out, "  (none)\n");
+     }
+     free(files);
+ }
+ 
+ /* Injected failures, so a run can be replayed with the same rules */
+ static void fault_report(void) {
+     if (!fault_count) {
+         return;
+     }
+     w_printf(&report_out, "\nInjected allocation failures: %zu\n", fault_count);
+     for (size_t i = 0; i < fault_count && i < MAX_FAULT_LOG; i++) {
+         const tracker_injection* e = &fault_log[i];
+         w_printf(&report_out, "  allocation %lu: %zu-byte %s at %s:%d, ", e->seq, e->size,
+                site_kind_names[e->site->kind], e->site->file, e->site->line);
+         if (e->rule == 0) {
+             w_printf(&report_out, "rule 0 (allocation #%lu)\n", fault_nth);
+         } else {
+             const FaultRule* r = &fault_rules[e->rule - 1];
+             w_printf(&report_out, "rule %d (%s:%d p=%g seed=%llu)\n", e->rule, r->file, r->line,
+                    r->p, (unsigned long long)r->seed);
+         }
+     }
+     if (fault_count > MAX_FAULT_LOG) {
+         w_printf(&report_out, "  ... %zu more not logged\n", fault_count - MAX_FAULT_LOG);
+     }
+ }
+ 
+ #if LEAK_TRACKER_TRACK
+ /* Name of a tag for the report: its label, or its number */
+ static const char* tag_label(unsigned tag) {
+     static char buf[16];
+     if (tag_stats[tag].name[0]) {
+         return tag_stats[tag].name;
+     }
+     snprintf(buf, sizeof(buf), "tag %u", tag);
+     return buf;
+ }
+ 
+ /* Tracked memory per tag, once any tag other than 0 has been used */
+ static void tag_report(void) {
+     int tagged = 0;
+     for (unsigned t = 1; t < LT_MAX_TAGS; t++) {
+         tagged |= tag_stats[t].alloc_calls != 0;
+     }
+     if (!tagged) {
+         return;
+     }
+     w_printf(&report_out, "\nTags:\n");
+     for (unsigned t = 0; t < LT_MAX_TAGS; t++) {
+         const TagStats* ts = &tag_stats[t];
+         if (!ts->alloc_calls) {
+             continue;
+         }
+         w_printf(&report_out, "  %-24s %zu allocation(s), %zu byte(s), %zu live block(s) (%zu bytes)\n",
+                t ? tag_label(t) : "untagged", ts->alloc_calls, ts->bytes_allocated,
+                ts->live_blocks, ts->live_bytes);
+     }
+ }
+ 
+ static int cross_free_cmp(const void* a, const void* b) {
+     const CrossFree* x = *(const CrossFree* const*)a;
+     const CrossFree* y = *(const CrossFree* const*)b;
+     return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+ }
+ 
+ /* Cross-thread frees, biggest (allocating thread, freeing thread, site) first */
+ #define CROSS_FREE_REPORT_MAX 20
+ static void cross_free_report(void) {
+     static const CrossFree* order[MAX_CROSS_FREES];
+     size_t n = 0;
+     if (!cross_free_blocks) {
+         return;
+     }
+     for (size_t i = 0; i < MAX_CROSS_FREES; i++) {
+         if (cross_frees[i].site) {
+             order[n++] = &cross_frees[i];
+         }
+     }
+     qsort(order, n, sizeof(order[0]), cross_free_cmp);
+     w_printf(&report_out, "\nCross-thread frees: %zu block(s), %zu byte(s)\n",
+            cross_free_blocks, cross_free_bytes);
+     for (size_t i = 0; i < n && i < CROSS_FREE_REPORT_MAX; i++) {
+         const CrossFree* c = order[i];
+         char where[256];
+         snprintf(where, sizeof(where), "%s:%d", c->site->file, c->site->line);
+         w_printf(&report_out, "  thread %-3u -> thread %-3u %-24s %zu block(s), %zu byte(s)\n",
+                c->alloc_thread, c->free_thread, where, c->blocks, c->bytes);
+     }
+     if (n > CROSS_FREE_REPORT_MAX) {
+         w_printf(&report_out, "  ... %zu more pair(s)\n", n - CROSS_FREE_REPORT_MAX);
+     }
+ }
+ 
+ static int site_pair_cmp(const void* a, const void* b) {
+     const SitePair* x = *(const SitePair* const*)a;
+     const SitePair* y = *(const SitePair* const*)b;
+     if (x->alloc_site->id != y->alloc_site->id) {
+         return x->alloc_site->id < y->alloc_site->id ? -1 : 1;
+     }
+     return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+ }
+ 
+ /*
+  * Where each allocation site's blocks were released, grouped by allocation
+  * site; "*" marks releases in another file than the allocation.
+  */
+ #define SITE_PAIR_REPORT_MAX 40
+ static void site_pair_report(void) {
+     static const SitePair* order[MAX_SITE_PAIRS];
+     size_t n = 0;
+     for (size_t i = 0; i < MAX_SITE_PAIRS; i++) {
+         if (site_pairs[i].alloc_site) {
+             order[n++] = &site_pairs[i];
+         }
+     }
+     if (!n) {
+         return;
+     }
+     qsort(order, n, sizeof(order[0]), site_pair_cmp);
+     w_printf(&report_out, "\nOwnership (allocation site -> release site):\n");
+     const lt_site* group = NULL;
+     for (size_t i = 0; i < n && i < SITE_PAIR_REPORT_MAX; i++) {
+         const SitePair* sp = order[i];
+         if (sp->alloc_site != group) {
+             group = sp->alloc_site;
+             w_printf(&report_out, "  %s:%d\n", group->file, group->line);
+         }
+         char where[256];
+         snprintf(where, sizeof(where), "%s:%d", sp->free_site->file, sp->free_site->line);
+         w_printf(&report_out, "    %s %-24s %zu block(s), %zu byte(s)\n",
+                strcmp(sp->free_site->file, group->file) ? "*" : "-", where,
+                sp->blocks, sp->bytes);
+     }
+     if (n > SITE_PAIR_REPORT_MAX) {
+         w_printf(&report_out, "  ... %zu more pair(s)\n", n - SITE_PAIR_REPORT_MAX);
+     }
+     if (site_pair_dropped) {
+         w_printf(&report_out, "  %zu release(s) not mapped (table full)\n", site_pair_dropped);
+     }
+ }
+ #endif
+ 
+ /* The atexit handler prints summary + any leaked blocks */
+ /*
+  * The report goes to the file set with tracker_set_report_file() (or
+  * LEAK_TRACKER_REPORT_FILE), "%p" replaced by the pid. Otherwise, with
+  * LEAK_TRACKER_OUTPUT_DIR set, every process writes it to
+  * <dir>/leak_tracker.<pid>.txt, so a process tree (forked children, and
+  * exec'd ones that inherit the environment) leaves one file per process
+  * for tools/lt-merge.sh. Falls back to stdout if the file cannot be made.
+  */
+ static void report_open(LtWriter* w) {
+     static char fallback[4096];
+     char path[4096];
+     const char* dir = getenv("LEAK_TRACKER_OUTPUT_DIR");
+     if (report_pattern[0]) {
+         expand_pid(path, sizeof(path), report_pattern);
+     } else if (dir && *dir) {
+         snprintf(path, sizeof(path), "%s/leak_tracker.%d.txt", dir, (int)getpid());
+     } else {
+         path[0] = '\0';
+     }
+     w->fd = 1;
+     if (path[0]) {
+         w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+         if (w->fd < 0) {
+             fprintf(stderr, "leak_tracker WARNING: cannot write %s, reporting to stdout\n", path);
+             w->fd = 1;
+         }
+     }
+     if (w->fd == 1) {
+         fflush(stdout);   // the program's own output comes first
+     }
+     w->len = 0;
+     w->cap = REPORT_BUF_SIZE;
+     w->buf = (char*)mmap(NULL, w->cap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+     if (w->buf == MAP_FAILED) {
+         w->buf = fallback;
+         w->cap = sizeof(fallback);
+     }
+ }
+ 
+ static void report_close(LtWriter* w) {
+     w_flush(w);
+     if (w->cap == REPORT_BUF_SIZE) {   // not the fallback
+         munmap(w->buf, w->cap);
+     }
+     if (w->fd != 1) {
+         close(w->fd);
+     }
+ }
+ 
+ static void leak_report(void) {
+     size_t alloc_calls, free_calls, bytes_allocated;
+     pthread_mutex_lock(&tracker_lock);
+     if (report_detail == REPORT_NONE) {
+ #if LEAK_TRACKER_TRACK
+         if (meta_hdr) {
+             meta_hdr->state = LT_META_EXITED;
+         }
+ #endif
+         pthread_mutex_unlock(&tracker_lock);
+         return;
+     }
+     fold_counters(&alloc_calls, &free_calls, &bytes_allocated);
+     report_open(&report_out);
+ 
+     if (has_forked || report_out.fd != 1) {
+         w_printf(&report_out, "\n===== Memory Leak Report (pid %d) =====\n", (int)getpid());
+         if (parent_pid) {
+             w_printf(&report_out, "Forked from pid %d; counts start at the fork\n", (int)parent_pid);
+         }
+     } else {
+         w_printf(&report_out, "\n===== Memory Leak Report =====\n");
+     }
+     w_printf(&report_out, "Total malloc/calloc/realloc calls: %zu\n", alloc_calls);
+     w_printf(&report_out, "Total free calls:                  %zu\n", free_calls);
+     w_printf(&report_out, "Total bytes allocated:             %zu\n", bytes_allocated);
+ #if LEAK_TRACKER_TRACK
+     size_t leaked_blocks = 0;
+     size_t leaked_bytes  = 0;
+ 
+     if (untracked_frees_ok) {
+         // Sampled blocks are the only ones whose size is known
+         w_printf(&report_out, "Tracked bytes freed:               %zu\n", total_bytes_freed);
+         if (tracking_mode == LT_MODE_COUNT) {
+             w_printf(&report_out, "Tracking:                          off (mode=count), calls counted only\n");
+             w_printf(&report_out, "Live bytes (usable size):          %zu\n", usable_live());
+         } else if (tracking_mode == LT_MODE_SAMPLE) {
+             w_printf(&report_out, "Sampling:                          1 in %lu allocation(s) tracked\n",
+                    sample_interval);
+         }
+     } else {
+         w_printf(&report_out, "Total bytes freed:                 %zu\n", total_bytes_freed);
+     }
+     if (mode_switches) {
+         w_printf(&report_out, "Mode switches:                     %zu, mode=%s since allocation %zu "
+                  "(blocks from a cheaper mode not listed)\n",
+                  mode_switches, mode_name(tracking_mode), mode_switch_allocs);
+     }
+     if (overhead_on) {
+         w_printf(&report_out, "Overhead control:                  budget %.2f%%, last %.2f%%, "
+                  "sampling %lux sparser now, %lux at most\n",
+                  overhead_budget * 100, overhead_share * 100,
+                  1ul << overhead_shift, 1ul << overhead_peak_shift);
+     }
+     w_printf(&report_out, "Double‐free attempts:              %zu\n", double_free_count);
+     w_printf(&report_out, "Invalid free attempts:             %zu\n", invalid_free_count);
+     if (budgets_active || budget_denial_count) {
+         w_printf(&report_out, "Allocations over budget:           %zu\n", budget_denial_count);
+     }
+ #if LEAK_TRACKER_REDZONES
+     // Leaked blocks are never freed, so check their guard bytes now
+     for (size_t i = 0; i < block_cap; i++) {
+         if (rec_is_live(&block_table[i])) {
+             AllocInfo info = rec_unpack(&block_table[i]);
+             redzone_check(&info, "exit", "(leak report)", 0);
+         }
+     }
+     w_printf(&report_out, "Heap overflows (redzone):          %zu\n", redzone_overflow_count);
+ #endif
+ 
+     if (inherited_blocks) {
+         w_printf(&report_out, "Inherited from parent:             %zu block(s), %zu byte(s) (not listed)\n",
+                inherited_blocks, inherited_bytes);
+     }
+     if (quarantine_limit) {
+         w_printf(&report_out, "Quarantine:                        %zu block(s), %zu byte(s) held\n",
+                  quarantine_count, quarantine_bytes);
+     }
+ 
+     if (live_block_count == inherited_blocks) {
+         if (tracking_mode != LT_MODE_COUNT) {
+             w_printf(&report_out, "No leaks detected!\n");
+         }
+     } else {
+         if (report_detail == REPORT_FULL) {
+             w_printf(&report_out, "\nLeaked blocks:\n");
+         }
+         for (size_t i = 0; i < block_cap; i++) {
+             if (!rec_is_live(&block_table[i]) || (block_table[i].meta & REC_INHERITED)) {
+                 continue;
+             }
+             AllocInfo curr = rec_unpack(&block_table[i]);
+             leaked_blocks++;
+             leaked_bytes += curr.size;
+             if (report_detail != REPORT_FULL) {
+                 continue;
+             }
+             // "  Leak at %p: %zu bytes (allocated at %s:%d)", by hand
+             w_str(&report_out, "  Leak at ");
+             w_ptr(&report_out, curr.ptr);
+             w_str(&report_out, ": ");
+             w_u64(&report_out, curr.size);
+             w_str(&report_out, " bytes (allocated at ");
+             w_str(&report_out, curr.site->file);
+             w_str(&report_out, ":");
+             w_u64(&report_out, (uint64_t)curr.site->line);
+             w_str(&report_out, ")");
+             if (curr.tag) {
+                 w_str(&report_out, " [");
+                 w_str(&report_out, tag_label(curr.tag));
+                 w_str(&report_out, "]");
+             }
+             if (thread_id_seq > 1) {
+                 if (curr.thread) {
+                     w_str(&report_out, " [thread ");
+                     w_u64(&report_out, curr.thread);
+                     w_str(&report_out, "]");
+                 } else {
+                     w_str(&report_out, " [exited thread]");
+                 }
+             }
+             w_str(&report_out, "\n");
+ #if LEAK_TRACKER_STACKS
+             const BlockStack* st = &block_stacks[i];
+             char** symbols = backtrace_symbols(st->frames, st->depth);
+             for (int k = 0; k < st->depth; k++) {
+                 w_str(&report_out, "      #");
+                 w_u64(&report_out, (uint64_t)k);
+                 w_str(&report_out, " ");
+                 w_str(&report_out, symbols ? symbols[k] : "?");
+                 w_str(&report_out, "\n");
+             }
+             free(symbols);
+ #endif
+         }
+         w_printf(&report_out, "\nSummary: %zu block(s) leaked, total %zu byte(s) unfreed.\n",
+                leaked_blocks, leaked_bytes);
+     }
+     tag_report();
+     cross_free_report();
+     site_pair_report();
+ #else
+     if (lt_count_usable) {
+         w_printf(&report_out, "Live bytes (usable size):          %zu\n", usable_live());
+     }
+     w_printf(&report_out, "Leak detection not compiled in (LEAK_TRACKER_TRACK=0).\n");
+ #endif /* LEAK_TRACKER_TRACK */
+     if (lt_count_usable) {
+         balance_report();
+     }
+     site_report();
+     fault_report();
+ #ifdef LEAK_TRACKER_PERF
+     perf_report();
+ #endif
+     w_printf(&report_out, "===== End of Report =====\n");
+     report_close(&report_out);
+ #if LEAK_TRACKER_TRACK
+     if (meta_hdr) {
+         meta_hdr->state = LT_META_EXITED;
+     }
+ #endif
+     pthread_mutex_unlock(&tracker_lock);
+ }
+ #endif /* LEAK_TRACKER_ENABLED */
+ 
+ /* -------------------------------------------------------------------
+  * Introspection
+  * -------------------------------------------------------------------
+  */
+ void tracker_get_stats(tracker_stats* out) {
+     memset(out, 0, sizeof(*out));
+ #if LEAK_TRACKER_ENABLED
+     pthread_mutex_lock(&tracker_lock);
+     fold_counters(&out->alloc_calls, &out->free_calls, &out->bytes_allocated);
+     out->usable_live_bytes = usable_live();
+ #if LEAK_TRACKER_TRACK
+     out->bytes_freed       = total_bytes_freed;
+     out->double_frees      = double_free_count;
+     out->invalid_frees     = invalid_free_count;
+     out->live_blocks       = live_block_count;
+     out->live_bytes        = live_byte_count;
+     out->budget_denials    = budget_denial_count;
+     out->cross_thread_frees = cross_free_blocks;
+ #endif
+ #if LEAK_TRACKER_REDZONES
+     out->redzone_overflows = redzone_overflow_count;
+ #endif
+     pthread_mutex_unlock(&tracker_lock);
+ #endif
+ }
+ 
+ void tracker_foreach_live(tracker_live_fn fn, void* ctx) {
+ #if LEAK_TRACKER_TRACK
+     pthread_mutex_lock(&tracker_lock);
+     for (size_t i = 0; i < block_cap; i++) {
+         const BlockRec* r = &block_table[i];
+         if (rec_is_live(r)) {
+             fn(r->ptr, REC_SIZE(r), r->site->file, r->site->line, ctx);
+         }
+     }
+     pthread_mutex_unlock(&tracker_lock);
+ #else
+     (void)fn;
+     (void)ctx;
+ #endif
+ }
+ 
+ int tracker_find_block(const void* addr, tracker_block* out) {
+ #if LEAK_TRACKER_TRACK
+     pthread_mutex_lock(&tracker_lock);
+     if (!bt_root) {
+         if (bt_reserve() != 0) {
+             pthread_mutex_unlock(&tracker_lock);
+             return 0;
+         }
+         bt_root = bt_node(1);
+         for (size_t i = 0; i < block_cap && bt_root; i++) {
+             if (rec_is_live(&block_table[i])) {
+                 index_add(block_table[i].ptr);
+             }
+         }
+         if (!bt_root) {
+             pthread_mutex_unlock(&tracker_lock);
+             return 0;
+         }
+     }
+     // Blocks do not overlap: only the last one starting at or below addr can hold it
+     uintptr_t start = index_floor((uintptr_t)addr);
+     size_t    i     = start ? table_find((const void*)start) : SIZE_MAX;
+     int       found = 0;
+     if (i != SIZE_MAX) {
+         const BlockRec* r = &block_table[i];
+         size_t size = REC_SIZE(r);
+         // A zero-size block still owns its first byte
+         found = (uintptr_t)addr - start < (size ? size : 1);
+         if (found) {
+             out->ptr    = r->ptr;
+             out->size   = size;
+             out->file   = r->site->file;
+             out->line   = r->site->line;
+             out->tag    = REC_TAG(r);
+             out->thread = REC_THREAD(r);
+         }
+     }
+     pthread_mutex_unlock(&tracker_lock);
+     return found;
+ #else
+     (void)addr;
+     (void)out;
+     return 0;
+ #endif
+ }
+ 
+ void tracker_foreach_site(tracker_site_fn fn, void* ctx) {
+ #if LEAK_TRACKER_ENABLED
+     pthread_mutex_lock(&tracker_lock);
+     site_counts_sync();
+     for (int r = 0; r < site_range_count; r++) {
+         for (const lt_site* s = site_ranges[r].begin; s < site_ranges[r].end; s++) {
+             fn(s, ctx);
+         }
+     }
+     pthread_mutex_unlock(&tracker_lock);
+ #else
+     (void)fn;
+     (void)ctx;
+ #endif
+ }
+ 
+ /* -------------------------------------------------------------------
+  * Sampling configuration
+  * -------------------------------------------------------------------
+  */
+ #if LEAK_TRACKER_TRACK
+ /* Puts a mode in effect; lock held */
+ static void set_tracking(int mode, unsigned long interval) {
+     size_t allocs, frees, bytes;
+     fold_counters(&allocs, &frees, &bytes);
+     if (mode != tracking_mode && allocs) {
+         mode_switches++;
+         mode_switch_allocs = allocs;
+     }
+     tracking_mode   = mode;
+     sample_interval = mode == LT_MODE_FULL ? 1 : interval;
+     // Back in full tracking a block from the cheaper mode cannot be told
+     // from a bad pointer, so every free is checked against the table again
+     untracked_frees_ok = mode != LT_MODE_FULL;
+     __atomic_store_n(&lt_free_fast, (unsigned char)(mode != LT_MODE_FULL), __ATOMIC_RELAXED);
+     if (mode == LT_MODE_COUNT && !lt_count_usable) {
+         // Frees went uncounted while away: start the live total again from here
+         usable_base = usable_total();
+     }
+     __atomic_store_n(&lt_count_usable, (unsigned char)(mode == LT_MODE_COUNT), __ATOMIC_RELAXED);
+     // Every thread's countdown was armed under the old mode
+     __atomic_add_fetch(&lt_config_gen, 1, __ATOMIC_RELAXED);
+ }
+ 
+ /*
+  * The mode in effect is the one asked for, sampled 2^overhead_shift times
+  * more sparsely while the overhead controller throttles it.
+  */
+ static void set_throttled(void) {
+     if (base_mode == LT_MODE_COUNT || !overhead_shift) {
+         set_tracking(base_mode, base_interval);
+         return;
+     }
+     unsigned long interval = base_mode == LT_MODE_FULL ? 1 : base_interval;
+     interval = interval > (ULONG_MAX >> overhead_shift) ? ULONG_MAX : interval << overhead_shift;
+     set_tracking(LT_MODE_SAMPLE, interval);
+ }
+ 
+ /* Switch to counting, sampling (one in 'interval') or full tracking; lock held */
+ static void apply_mode(int mode, unsigned long interval) {
+     base_mode     = mode;
+     base_interval = mode == LT_MODE_FULL ? 1 : interval;
+     set_throttled();
+ }
+ 
+ /* Async-signal-safe: the switch itself waits for a slow path */
+ static void mode_signal_handler(int sig) {
+     (void)sig;
+     __atomic_add_fetch(&mode_signals, 1, __ATOMIC_RELAXED);
+     __atomic_add_fetch(&lt_config_gen, 1, __ATOMIC_RELAXED);
+ }
+ 
+ static int mode_signal_install(int sig) {
+     struct sigaction sa;
+     memset(&sa, 0, sizeof(sa));
+     sa.sa_handler = mode_signal_handler;
+     sa.sa_flags   = SA_RESTART;
+     sigemptyset(&sa.sa_mask);
+     if (sig <= 0 || sig >= NSIG || sigaction(sig, &sa, NULL) != 0) {
+         return -1;
+     }
+     mode_signal_number = sig;
+     return 0;
+ }
+ 
+ /* Reads the control file; returns the mode in it, or -1 */
+ static int control_read(unsigned long* interval) {
+     char buf[64];
+     *interval = 0;
+     int fd = open(control_path, O_RDONLY | O_CLOEXEC);
+     if (fd < 0) {
+         return -1;
+     }
+     ssize_t n = read(fd, buf, sizeof(buf) - 1);
+     close(fd);
+     buf[n > 0 ? n : 0] = '\0';
+     char* word = buf + strspn(buf, " \t\n");
+     size_t len = strcspn(word, " \t\n");
+     char* arg = word + len + strspn(word + len, " \t\n");
+     word[len] = '\0';
+     *interval = strtoul(arg, NULL, 10);
+     return strcmp(word, "count")  == 0 ? LT_MODE_COUNT :
+            strcmp(word, "sample") == 0 ? LT_MODE_SAMPLE :
+            strcmp(word, "full")   == 0 ? LT_MODE_FULL : -1;
+ }
+ 
+ /* The poll thread: applies the control file each time its content changes */
+ static void* control_main(void* arg) {
+     (void)arg;
+     int           last_mode     = -1;
+     unsigned long last_interval = 0;
+     for (;;) {
+         unsigned long interval;
+         int mode = control_read(&interval);
+         if (mode >= 0 && (mode != last_mode || interval != last_interval)) {
+             pthread_mutex_lock(&tracker_lock);
+             int prev = base_mode;
+             if (mode == LT_MODE_SAMPLE && interval > 1) {
+                 sample_rate = interval;
+             }
+             apply_mode(mode, sample_rate);
+             pthread_mutex_unlock(&tracker_lock);
+             if (last_mode >= 0 || mode != prev) {
+                 fprintf(stderr, "leak_tracker: %s: mode=%s (was %s)\n",
+                         control_path, mode_name(mode), mode_name(prev));
+             }
+         }
+         last_mode     = mode;
+         last_interval = interval;
+         sleep(1);
+     }
+     return NULL;
+ }
+ 
+ /* Starts the poll thread with every signal blocked; lock held */
+ static int control_start(void) {
+     pthread_t tid;
+     pthread_attr_t attr;
+     sigset_t all, old;
+     sigfillset(&all);
+     pthread_attr_init(&attr);
+     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+     pthread_sigmask(SIG_SETMASK, &all, &old);
+     int err = pthread_create(&tid, &attr, control_main, NULL);
+     pthread_sigmask(SIG_SETMASK, &old, NULL);
+     pthread_attr_destroy(&attr);
+     control_running = err == 0;
+     return err;
+ }
+ 
+ /* From slow_path_enter: apply pending mode signals, restart the poller after a fork */
+ static void mode_requests(void) {
+     unsigned steps = __atomic_exchange_n(&mode_signals, 0, __ATOMIC_RELAXED);
+     if (steps) {
+         int prev = base_mode;
+         apply_mode((int)((base_mode + steps) % 3), sample_rate);
+         fprintf(stderr, "leak_tracker: signal %d: mode=%s (was %s)\n",
+                 mode_signal_number, mode_name(base_mode), mode_name(prev));
+     }
+     if (control_path[0] && !control_running && control_start() != 0) {
+         control_path[0] = '\0';        // do not retry on every slow path
+     }
+ }
+ #endif
  
- /* Undefine macros so we can call the real malloc/free here */
- #ifdef malloc
- #undef malloc
+ void tracker_set_sample_interval(unsigned long n) {
+ #if LEAK_TRACKER_TRACK
+     pthread_mutex_lock(&tracker_lock);
+     if (n > 1) {
+         sample_rate = n;
+     }
+     apply_mode(n > 1 ? LT_MODE_SAMPLE : LT_MODE_FULL, n);
+     pthread_mutex_unlock(&tracker_lock);
+ #else
+     (void)n;
  #endif
- #ifdef calloc
- #undef calloc
+ }
+ 
+ int tracker_set_mode(int mode) {
+ #if LEAK_TRACKER_TRACK
+     if (mode < LT_MODE_COUNT || mode > LT_MODE_FULL) {
+         return -1;
+     }
+     pthread_mutex_lock(&tracker_lock);
+     apply_mode(mode, sample_rate);
+     pthread_mutex_unlock(&tracker_lock);
+     return 0;
+ #elif LEAK_TRACKER_ENABLED
+     if (mode != LT_MODE_COUNT) {
+         return -1;
+     }
+     __atomic_store_n(&lt_count_usable, 1, __ATOMIC_RELAXED);
+     return 0;
+ #else
+     (void)mode;
+     return -1;
  #endif
- #ifdef realloc
- #undef realloc
+ }
+ 
+ int tracker_get_mode(void) {
+ #if LEAK_TRACKER_TRACK
+     return __atomic_load_n(&base_mode, __ATOMIC_RELAXED);
+ #elif LEAK_TRACKER_ENABLED
+     return LT_MODE_COUNT;
+ #else
+     return -1;
  #endif
- #ifdef free
- #undef free
+ }
+ 
+ /* -------------------------------------------------------------------
+  * Overhead control
+  * -------------------------------------------------------------------
+  */
+ #if LEAK_TRACKER_TRACK
+ /*
+  * The slow paths time their locked part, the tracker's own work, with the
+  * cycle counter: one call in 16 per thread, scaled up, or every call once
+  * throttling has made them rare. Every OVERHEAD_WINDOW_NS the ticks are
+  * compared with the window's ticks times the threads that took a slow
+  * path in it. Over the budget, the sampling interval grows by the power
+  * of two that brings the share back under it; under a quarter of the
+  * budget it halves again.
+  */
+ static void overhead_adjust(uint64_t now_ns, uint64_t now_ticks) {
+     pthread_mutex_lock(&tracker_lock);
+     if (now_ns - overhead_window_ns < OVERHEAD_WINDOW_NS) {
+         pthread_mutex_unlock(&tracker_lock);
+         return;                         // another thread closed the window
+     }
+     uint64_t ticks   = __atomic_exchange_n(&overhead_ticks_sum, 0, __ATOMIC_RELAXED);
+     unsigned threads = __atomic_exchange_n(&overhead_threads, 0, __ATOMIC_RELAXED);
+     uint64_t wall    = (now_ticks - overhead_window_ticks) * (threads ? threads : 1);
+     double   share   = wall ? (double)ticks / (double)wall : 0;
+     int      shift   = overhead_shift;
+     if (share > overhead_budget) {
+         for (double s = share; s > overhead_budget && shift < OVERHEAD_MAX_SHIFT; s /= 2) {
+             shift++;
+         }
+     } else if (share < overhead_budget / 4 && shift > 0) {
+         shift--;
+     }
+     overhead_share = share;
+     if (shift != overhead_shift) {
+         if (shift > overhead_peak_shift) {
+             overhead_peak_shift = shift;
+         }
+         overhead_shift = shift;
+         overhead_every = shift >= OVERHEAD_EVERY_SHIFT ? 1 : 1u << (OVERHEAD_EVERY_SHIFT - shift);
+         set_throttled();
+     }
+     overhead_window++;
+     overhead_window_ns    = now_ns;
+     overhead_window_ticks = now_ticks;
+     pthread_mutex_unlock(&tracker_lock);
+ }
+ 
+ /* Taken before the lock; 0 = this call is not measured */
+ static inline uint64_t overhead_begin(void) {
+     if (LT_LIKELY(!__atomic_load_n(&overhead_on, __ATOMIC_RELAXED)) || --overhead_countdown > 0) {
+         return 0;
+     }
+     overhead_scale     = __atomic_load_n(&overhead_every, __ATOMIC_RELAXED);
+     overhead_countdown = overhead_scale;
+     return overhead_ticks();
+ }
+ 
+ /* Taken after the unlock */
+ static void overhead_end(uint64_t t0) {
+     if (LT_LIKELY(!t0)) {
+         return;
+     }
+     uint64_t now = overhead_ticks();
+     __atomic_fetch_add(&overhead_ticks_sum, (now - t0) * overhead_scale, __ATOMIC_RELAXED);
+     unsigned window = __atomic_load_n(&overhead_window, __ATOMIC_RELAXED);
+     if (overhead_thread_window != window) {
+         overhead_thread_window = window;
+         __atomic_add_fetch(&overhead_threads, 1, __ATOMIC_RELAXED);
+     }
+     struct timespec ts;
+     clock_gettime(OVERHEAD_CLOCK, &ts);
+     uint64_t ns = (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+     if (ns - __atomic_load_n(&overhead_window_ns, __ATOMIC_RELAXED) >= OVERHEAD_WINDOW_NS) {
+         overhead_adjust(ns, now);
+     }
+ }
+ #define OVERHEAD_BEGIN(t)  uint64_t t = overhead_begin()
+ #define OVERHEAD_END(t)    overhead_end(t)
+ #else
+ #define OVERHEAD_BEGIN(t)  do { } while (0)
+ #define OVERHEAD_END(t)    do { } while (0)
  #endif
  
- /* ----- Allocation tracking ----- */
+ void tracker_set_overhead_budget(double percent) {
+ #if LEAK_TRACKER_TRACK
+     pthread_mutex_lock(&tracker_lock);
+     struct timespec ts;
+     clock_gettime(OVERHEAD_CLOCK, &ts);
+     overhead_budget       = percent > 0 ? percent / 100 : 0;
+     overhead_window_ns    = (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+     overhead_window_ticks = overhead_ticks();
+     __atomic_store_n(&overhead_ticks_sum, 0, __ATOMIC_RELAXED);
+     __atomic_store_n(&overhead_threads, 0, __ATOMIC_RELAXED);
+     overhead_window++;
+     if (!overhead_budget && overhead_shift) {
+         overhead_shift = 0;
+         set_throttled();
+     }
+     overhead_every = overhead_shift >= OVERHEAD_EVERY_SHIFT ? 1 : 1u << (OVERHEAD_EVERY_SHIFT - overhead_shift);
+     __atomic_store_n(&overhead_on, (unsigned char)(overhead_budget > 0), __ATOMIC_RELAXED);
+     pthread_mutex_unlock(&tracker_lock);
+ #else
+     (void)percent;
+ #endif
+ }
  
- /* Node for active allocations */
- typedef struct AllocInfo {
-     void*               ptr;    // pointer returned by malloc/calloc/realloc
-     size_t              size;   // size of that allocation
-     const char*         file;   // file where it was allocated
-     int                 line;   // line where it was allocated
-     struct AllocInfo*   next;   // next node in list
- } AllocInfo;
+ /* -------------------------------------------------------------------
+  * Allocation tags
+  * -------------------------------------------------------------------
+  */
+ unsigned tracker_set_tag(unsigned tag) {
+ #if LEAK_TRACKER_TRACK
+     unsigned prev = current_tag;
+     current_tag = tag < LT_MAX_TAGS ? tag : 0;
+     return prev;
+ #else
+     (void)tag;
+     return 0;
+ #endif
+ }
  
- /* Node for freed pointers */
- typedef struct FreedInfo {
-     void*               ptr;    // pointer that was freed
-     struct FreedInfo*   next;   // next freed node
- } FreedInfo;
+ void tracker_name_tag(unsigned tag, const char* name) {
+ #if LEAK_TRACKER_TRACK
+     if (tag >= LT_MAX_TAGS || !name) {
+         return;
+     }
+     pthread_mutex_lock(&tracker_lock);
+     snprintf(tag_stats[tag].name, sizeof(tag_stats[tag].name), "%s", name);
+     pthread_mutex_unlock(&tracker_lock);
+ #else
+     (void)tag;
+     (void)name;
+ #endif
+ }
  
- static AllocInfo*  head_allocs      = NULL;  // active allocations
- static FreedInfo*  head_freed       = NULL;  // pointers already freed
+ void tracker_get_tag_stats(unsigned tag, tracker_tag_stats* out) {
+     memset(out, 0, sizeof(*out));
+ #if LEAK_TRACKER_TRACK
+     if (tag >= LT_MAX_TAGS) {
+         return;
+     }
+     pthread_mutex_lock(&tracker_lock);
+     out->alloc_calls     = tag_stats[tag].alloc_calls;
+     out->bytes_allocated = tag_stats[tag].bytes_allocated;
+     out->live_blocks     = tag_stats[tag].live_blocks;
+     out->live_bytes      = tag_stats[tag].live_bytes;
+     pthread_mutex_unlock(&tracker_lock);
+ #else
+     (void)tag;
+ #endif
+ }
  
- /* Counters */
- static size_t total_alloc_calls      = 0;
- static size_t total_free_calls       = 0;
- static size_t total_bytes_allocated  = 0;
- static size_t total_bytes_freed      = 0;
- static size_t invalid_free_count     = 0;
- static size_t double_free_count      = 0;
+ void tracker_set_tag_budget(unsigned tag, size_t bytes) {
+ #if LEAK_TRACKER_TRACK
+     if (tag >= LT_MAX_TAGS) {
+         return;
+     }
+     pthread_mutex_lock(&tracker_lock);
+     tag_stats[tag].budget = bytes;
+     budget_rebind();
+     pthread_mutex_unlock(&tracker_lock);
+ #else
+     (void)tag;
+     (void)bytes;
+ #endif
+ }
  
- /* atexit handler registration flag */
- static int    atexit_registered = 0;
+ /* -------------------------------------------------------------------
+  * Per-thread attribution
+  * -------------------------------------------------------------------
+  */
+ unsigned tracker_thread_id(void) {
+ #if LEAK_TRACKER_TRACK
+     if (lt_tls.gen == 0) {
+         pthread_mutex_lock(&tracker_lock);
+         slow_path_enter(0);
+         pthread_mutex_unlock(&tracker_lock);
+     }
+     return thread_index;
+ #else
+     return 0;
+ #endif
+ }
  
- /* Forward declarations */
- static void   register_leak_report(void);
- static void   leak_report(void);
- static void   record_allocation(void* ptr, size_t size, const char* file, int line);
- static int    remove_allocation_node(void* ptr, size_t* out_size);
- static int    is_in_freed_list(void* ptr);
- static void   add_to_freed_list(void* ptr);
+ void tracker_get_thread_stats(unsigned id, tracker_thread_stats* out) {
+     memset(out, 0, sizeof(*out));
+ #if LEAK_TRACKER_TRACK
+     if (id >= LT_MAX_THREADS) {
+         return;
+     }
+     pthread_mutex_lock(&tracker_lock);
+     out->alloc_calls     = thread_stats[id].alloc_calls;
+     out->bytes_allocated = thread_stats[id].bytes_allocated;
+     out->live_blocks     = thread_stats[id].live_blocks;
+     out->live_bytes      = thread_stats[id].live_bytes;
+     pthread_mutex_unlock(&tracker_lock);
+ #else
+     (void)id;
+ #endif
+ }
  
- static void register_leak_report(void) {
-     if (!atexit_registered) {
-         atexit(leak_report);
-         atexit_registered = 1;
+ void tracker_foreach_cross_free(tracker_cross_free_fn fn, void* ctx) {
+ #if LEAK_TRACKER_TRACK
+     pthread_mutex_lock(&tracker_lock);
+     for (size_t i = 0; i < MAX_CROSS_FREES; i++) {
+         const CrossFree* c = &cross_frees[i];
+         if (c->site) {
+             tracker_cross_free e = { c->alloc_thread, c->free_thread, c->site,
+                                      c->blocks, c->bytes };
+             fn(&e, ctx);
+         }
+     }
+     pthread_mutex_unlock(&tracker_lock);
+ #else
+     (void)fn;
+     (void)ctx;
+ #endif
+ }
+ 
+ void tracker_foreach_site_pair(tracker_site_pair_fn fn, void* ctx) {
+ #if LEAK_TRACKER_TRACK
+     pthread_mutex_lock(&tracker_lock);
+     for (size_t i = 0; i < MAX_SITE_PAIRS; i++) {
+         const SitePair* sp = &site_pairs[i];
+         if (sp->alloc_site) {
+             tracker_site_pair e = { sp->alloc_site, sp->free_site, sp->blocks, sp->bytes };
+             fn(&e, ctx);
+         }
+     }
+     pthread_mutex_unlock(&tracker_lock);
+ #else
+     (void)fn;
+     (void)ctx;
+ #endif
+ }
+ 
+ void tracker_set_thread_exit_report(int on) {
+ #if LEAK_TRACKER_TRACK
+     pthread_mutex_lock(&tracker_lock);
+     thread_exit_reports = on;
+     pthread_mutex_unlock(&tracker_lock);
+ #else
+     (void)on;
+ #endif
+ }
+ 
+ /* -------------------------------------------------------------------
+  * Fault injection
+  * -------------------------------------------------------------------
+  */
+ #if LEAK_TRACKER_ENABLED
+ /* Recompute faults_active and push threads off the sampled fast path */
+ static void fault_refresh(void) {
+     faults_active = fault_nth != 0 || fault_rule_count != 0;
+     __atomic_add_fetch(&lt_config_gen, 1, __ATOMIC_RELAXED);
+ }
+ #endif
+ 
+ void tracker_fail_nth(unsigned long n) {
+ #if LEAK_TRACKER_ENABLED
+     pthread_mutex_lock(&tracker_lock);
+     fault_nth = n ? fault_seq + n : 0;
+     fault_refresh();
+     pthread_mutex_unlock(&tracker_lock);
+ #else
+     (void)n;
+ #endif
+ }
+ 
+ int tracker_fail_sites(const char* file, int line, double p, uint64_t seed) {
+ #if LEAK_TRACKER_ENABLED
+     if (!file || strlen(file) >= sizeof(fault_rules[0].file)) {
+         return -1;
+     }
+     pthread_mutex_lock(&tracker_lock);
+     if (fault_rule_count == MAX_FAULT_RULES) {
+         pthread_mutex_unlock(&tracker_lock);
+         return -1;
+     }
+     FaultRule* r = &fault_rules[fault_rule_count];
+     strcpy(r->file, file);
+     r->line = line;
+     r->p    = p;
+     r->seed = seed;
+     r->rng  = seed ? seed : 0x9E3779B97F4A7C15ULL;   // xorshift must not start at 0
+     int id = ++fault_rule_count;
+     fault_refresh();
+     pthread_mutex_unlock(&tracker_lock);
+     return id;
+ #else
+     (void)file;
+     (void)line;
+     (void)p;
+     (void)seed;
+     return -1;
+ #endif
+ }
+ 
+ void tracker_fail_clear(void) {
+ #if LEAK_TRACKER_ENABLED
+     pthread_mutex_lock(&tracker_lock);
+     fault_nth        = 0;
+     fault_rule_count = 0;
+     fault_seq        = 0;
+     fault_count      = 0;
+     fault_refresh();
+     pthread_mutex_unlock(&tracker_lock);
+ #endif
+ }
+ 
+ size_t tracker_get_injections(tracker_injection* out, size_t max) {
+ #if LEAK_TRACKER_ENABLED
+     pthread_mutex_lock(&tracker_lock);
+     size_t n = fault_count < MAX_FAULT_LOG ? fault_count : MAX_FAULT_LOG;
+     if (n > max) {
+         n = max;
+     }
+     memcpy(out, fault_log, n * sizeof(*out));
+     pthread_mutex_unlock(&tracker_lock);
+     return n;
+ #else
+     (void)out;
+     (void)max;
+     return 0;
+ #endif
+ }
+ 
+ /* -------------------------------------------------------------------
+  * Allocation budgets
+  * -------------------------------------------------------------------
+  */
+ void tracker_set_budget(size_t bytes) {
+ #if LEAK_TRACKER_TRACK
+     pthread_mutex_lock(&tracker_lock);
+     global_budget = bytes;
+     budget_rebind();
+     pthread_mutex_unlock(&tracker_lock);
+ #else
+     (void)bytes;
+ #endif
+ }
+ 
+ int tracker_set_site_budget(const char* file, int line, size_t bytes) {
+ #if LEAK_TRACKER_TRACK
+     if (!file || strlen(file) >= sizeof(budgets[0].file)) {
+         return -1;
+     }
+     pthread_mutex_lock(&tracker_lock);
+     int i = 0;
+     while (i < budget_count && !(budgets[i].line == line && strcmp(budgets[i].file, file) == 0)) {
+         i++;
+     }
+     if (i == MAX_BUDGETS) {
+         pthread_mutex_unlock(&tracker_lock);
+         return -1;
      }
+     if (i == budget_count) {
+         strcpy(budgets[i].file, file);
+         budgets[i].line = line;
+         budget_count++;
+     }
+     budgets[i].limit = bytes;
+     budget_rebind();
+     pthread_mutex_unlock(&tracker_lock);
+     return 0;
+ #else
+     (void)file;
+     (void)line;
+     (void)bytes;
+     return -1;
+ #endif
+ }
+ 
+ void tracker_set_budget_handler(tracker_budget_fn fn, void* ctx) {
+ #if LEAK_TRACKER_TRACK
+     pthread_mutex_lock(&tracker_lock);
+     budget_handler     = fn;
+     budget_handler_ctx = ctx;
+     pthread_mutex_unlock(&tracker_lock);
+ #else
+     (void)fn;
+     (void)ctx;
+ #endif
  }
  
- /* Insert a new allocation record */
- static void record_allocation(void* ptr, size_t size, const char* file, int line) {
-     AllocInfo* node = (AllocInfo*)malloc(sizeof(AllocInfo));
-     if (!node) {
-         fprintf(stderr, "leak_tracker: failed to allocate tracking node\n");
+ /* -------------------------------------------------------------------
+  * Crash report
+  * -------------------------------------------------------------------
+  */
+ #if LEAK_TRACKER_ENABLED
+ static const int crash_signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+ #define NUM_CRASH_SIGNALS (int)(sizeof(crash_signals) / sizeof(crash_signals[0]))
+ static struct sigaction crash_prev[NUM_CRASH_SIGNALS];
+ static int              crash_installed = 0;
+ static char             crash_dir[1024];    // LEAK_TRACKER_OUTPUT_DIR at install time
+ static volatile sig_atomic_t crash_active = 0;
+ 
+ #define CRASH_STACK_BYTES (1 << 16)
+ static __thread void*   crash_stack = NULL; // this thread's signal stack; MAP_FAILED = none of ours
+ 
+ /*
+  * Run the handler on a stack of the thread's own, so a stack overflow is
+  * reported too. sigaltstack() is per thread: each thread sets one up on
+  * its first slow path after the handlers were installed. A stack the
+  * program installed itself is left in place. Lock held.
+  */
+ static void crash_stack_check(void) {
+     if (!crash_installed || crash_stack) {
+         return;
+     }
+     stack_t ss;
+     if (sigaltstack(NULL, &ss) == 0 && !(ss.ss_flags & SS_DISABLE)) {
+         crash_stack = MAP_FAILED;
          return;
      }
-     node->ptr   = ptr;
-     node->size  = size;
-     node->file  = file;
-     node->line  = line;
-     node->next  = head_allocs;
-     head_allocs = node;
+     void* m = mmap(NULL, CRASH_STACK_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+     if (m != MAP_FAILED) {
+         ss.ss_sp    = m;
+         ss.ss_size  = CRASH_STACK_BYTES;
+         ss.ss_flags = 0;
+         if (sigaltstack(&ss, NULL) != 0) {
+             munmap(m, CRASH_STACK_BYTES);
+             m = MAP_FAILED;
+         }
+     }
+     crash_stack = m;
+ }
  
-     total_alloc_calls++;
-     total_bytes_allocated += size;
+ /* Thread exit: drop the thread's signal stack */
+ static void crash_stack_release(void) {
+     if (crash_stack && crash_stack != MAP_FAILED) {
+         stack_t ss;
+         memset(&ss, 0, sizeof(ss));
+         ss.ss_flags = SS_DISABLE;
+         sigaltstack(&ss, NULL);
+         munmap(crash_stack, CRASH_STACK_BYTES);
+     }
+     crash_stack = NULL;
  }
  
  /*
-  * Remove an allocation record for 'ptr'.
-  * If found, pop it from the active list, set *out_size = its size, free the node, return 1.
-  * If not found, return 0.
+  * Dump the counters and the live set (per call site and per tag) of a
+  * dying process. The tracker lock is not taken: the crash may have hit
+  * while it was held, so the numbers can be off by an operation in flight.
   */
- static int remove_allocation_node(void* ptr, size_t* out_size) {
-     AllocInfo* prev = NULL;
-     AllocInfo* cur  = head_allocs;
-     while (cur) {
-         if (cur->ptr == ptr) {
-             *out_size = cur->size;
-             if (prev) {
-                 prev->next = cur->next;
-             } else {
-                 head_allocs = cur->next;
+ static void crash_report(int fd, int sig) {
+     char buf[4096];
+     LtWriter w;
+     w.fd  = fd;
+     w.len = 0;
+     w.cap = sizeof(buf);
+     w.buf = buf;
+     size_t alloc_calls, free_calls, bytes_allocated;
+     fold_counters(&alloc_calls, &free_calls, &bytes_allocated);
+ 
+     w_str(&w, "\n===== Crash Report (signal ");
+     w_u64(&w, (uint64_t)sig);
+     w_str(&w, ", pid ");
+     w_u64(&w, (uint64_t)getpid());
+     w_str(&w, ") =====\nTotal malloc/calloc/realloc calls: ");
+     w_u64(&w, alloc_calls);
+     w_str(&w, "\nTotal free calls:                  ");
+     w_u64(&w, free_calls);
+     w_str(&w, "\nTotal bytes allocated:             ");
+     w_u64(&w, bytes_allocated);
+ #if LEAK_TRACKER_TRACK
+     w_str(&w, "\nLive tracked blocks:               ");
+     w_u64(&w, live_block_count);
+     w_str(&w, " (");
+     w_u64(&w, live_byte_count);
+     w_str(&w, " bytes)\n\nLive blocks by call site:\n");
+     for (int r = 0; r < site_range_count; r++) {
+         for (const lt_site* s = site_ranges[r].begin; s < site_ranges[r].end; s++) {
+             size_t live = s->tracked_blocks - s->freed_blocks;
+             if (!live) {
+                 continue;
              }
-             free(cur);
-             return 1;
+             w_str(&w, "  ");
+             w_str(&w, s->file);
+             w_str(&w, ":");
+             w_u64(&w, (uint64_t)s->line);
+             w_str(&w, "  ");
+             w_u64(&w, live);
+             w_str(&w, " block(s), ");
+             w_u64(&w, s->live_bytes);
+             w_str(&w, " byte(s)\n");
          }
-         prev = cur;
-         cur  = cur->next;
      }
-     return 0;
+     int tag_header = 0;
+     for (unsigned t = 1; t < LT_MAX_TAGS; t++) {
+         if (!tag_stats[t].live_blocks) {
+             continue;
+         }
+         if (!tag_header) {
+             w_str(&w, "\nLive blocks by tag:\n");
+             tag_header = 1;
+         }
+         w_str(&w, "  tag ");
+         w_u64(&w, t);
+         if (tag_stats[t].name[0]) {
+             w_str(&w, " (");
+             w_str(&w, tag_stats[t].name);
+             w_str(&w, ")");
+         }
+         w_str(&w, "  ");
+         w_u64(&w, tag_stats[t].live_blocks);
+         w_str(&w, " block(s), ");
+         w_u64(&w, tag_stats[t].live_bytes);
+         w_str(&w, " byte(s)\n");
+     }
+ #else
+     w_str(&w, "\n");
+ #endif
+     w_str(&w, "===== End of Crash Report =====\n");
+     w_flush(&w);
  }
  
- /* Check if ptr is already in the freed list */
- static int is_in_freed_list(void* ptr) {
-     FreedInfo* cur = head_freed;
-     while (cur) {
-         if (cur->ptr == ptr) {
-             return 1;
+ static void crash_handler(int sig) {
+     int saved_errno = errno;
+     if (!crash_active) {
+         crash_active = 1;
+         int fd = 2;
+         if (crash_dir[0]) {
+             // <dir>/leak_tracker.<pid>.crash, built without snprintf
+             char buf[1100];
+             LtWriter path;
+             path.fd  = -1;
+             path.len = 0;
+             path.cap = sizeof(buf);
+             path.buf = buf;
+             w_str(&path, crash_dir);
+             w_str(&path, "/leak_tracker.");
+             w_u64(&path, (uint64_t)getpid());
+             w_str(&path, ".crash");
+             buf[path.len < sizeof(buf) ? path.len : sizeof(buf) - 1] = '\0';
+             fd = open(path.buf, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+             if (fd < 0) {
+                 fd = 2;
+             }
+         }
+         crash_report(fd, sig);
+         if (fd != 2) {
+             close(fd);
          }
-         cur = cur->next;
      }
-     return 0;
+     // Hand the signal to whoever had it before (normally: die with a core)
+     for (int i = 0; i < NUM_CRASH_SIGNALS; i++) {
+         if (crash_signals[i] == sig) {
+             sigaction(sig, &crash_prev[i], NULL);
+         }
+     }
+     errno = saved_errno;
+     raise(sig);
  }
+ #endif
  
- /* Add ptr to freed list (so future frees can be detected as double‐free) */
- static void add_to_freed_list(void* ptr) {
-     FreedInfo* node = (FreedInfo*)malloc(sizeof(FreedInfo));
-     if (!node) {
-         fprintf(stderr, "leak_tracker: failed to allocate FreedInfo\n");
-         return;
+ void tracker_set_crash_report(int on) {
+ #if LEAK_TRACKER_ENABLED
+     pthread_mutex_lock(&tracker_lock);
+     if (on && !crash_installed) {
+         const char* dir = getenv("LEAK_TRACKER_OUTPUT_DIR");
+         snprintf(crash_dir, sizeof(crash_dir), "%s", dir ? dir : "");
+         struct sigaction sa;
+         memset(&sa, 0, sizeof(sa));
+         sa.sa_handler = crash_handler;
+         sa.sa_flags   = SA_ONSTACK;
+         sigemptyset(&sa.sa_mask);
+         for (int i = 0; i < NUM_CRASH_SIGNALS; i++) {
+             sigaction(crash_signals[i], &sa, &crash_prev[i]);
+         }
+         crash_installed = 1;
+         crash_stack_check();
+         // Send the other threads through the slow path for their own stacks
+         __atomic_add_fetch(&lt_config_gen, 1, __ATOMIC_RELAXED);
+     } else if (!on && crash_installed) {
+         for (int i = 0; i < NUM_CRASH_SIGNALS; i++) {
+             sigaction(crash_signals[i], &crash_prev[i], NULL);
+         }
+         crash_installed = 0;
      }
-     node->ptr  = ptr;
-     node->next = head_freed;
-     head_freed = node;
+     pthread_mutex_unlock(&tracker_lock);
+ #else
+     (void)on;
+ #endif
  }
  
- /* The atexit handler prints summary + any leaked blocks */
- static void leak_report(void) {
-     size_t leaked_blocks = 0;
-     size_t leaked_bytes  = 0;
-     AllocInfo* curr = head_allocs;
- 
-     printf("\n===== Memory Leak Report =====\n");
-     printf("Total malloc/calloc/realloc calls: %zu\n", total_alloc_calls);
-     printf("Total free calls:                  %zu\n", total_free_calls);
-     printf("Total bytes allocated:             %zu\n", total_bytes_allocated);
-     printf("Total bytes freed:                 %zu\n", total_bytes_freed);
-     printf("Double‐free attempts:              %zu\n", double_free_count);
-     printf("Invalid free attempts:             %zu\n", invalid_free_count);
- 
-     if (!curr) {
-         printf("No leaks detected!\n");
+ /* -------------------------------------------------------------------
+  * Metadata file
+  * -------------------------------------------------------------------
+  */
+ int tracker_set_metadata_file(const char* path) {
+ #if LEAK_TRACKER_TRACK
+     int rc = 0;
+     pthread_mutex_lock(&tracker_lock);
+     if (!path) {
+         meta_close();
+         meta_pattern[0] = '\0';
      } else {
-         printf("\nLeaked blocks:\n");
-         while (curr) {
-             leaked_blocks++;
-             leaked_bytes += curr->size;
-             printf("  Leak at %p: %zu bytes (allocated at %s:%d)\n",
-                    curr->ptr, curr->size, curr->file, curr->line);
-             curr = curr->next;
-         }
-         printf("\nSummary: %zu block(s) leaked, total %zu byte(s) unfreed.\n",
-                leaked_blocks, leaked_bytes);
+         snprintf(meta_pattern, sizeof(meta_pattern), "%s", path);
+         rc = meta_open();
      }
-     printf("===== End of Report =====\n");
+     pthread_mutex_unlock(&tracker_lock);
+     return rc;
+ #else
+     (void)path;
+     return -1;
+ #endif
+ }
+ 
+ void tracker_set_report_file(const char* path) {
+ #if LEAK_TRACKER_ENABLED
+     pthread_mutex_lock(&tracker_lock);
+     snprintf(report_pattern, sizeof(report_pattern), "%s", path ? path : "");
+     pthread_mutex_unlock(&tracker_lock);
+ #else
+     (void)path;
+ #endif
  }
  
+ #if LEAK_TRACKER_ENABLED
  /* -------------------------------------------------------------------
-  * my_malloc
+  * malloc slow path (my_malloc in leak_tracker.h is the fast path)
   * -------------------------------------------------------------------
   */
- void* my_malloc(size_t size, const char* file, int line) {
-     if (!atexit_registered) {
-         register_leak_report();
+ void* lt_malloc_slow(size_t size, lt_site* site) {
+     void* ptr = NULL;
+     if (__atomic_load_n(&faults_active, __ATOMIC_RELAXED) && fault_inject(site, size)) {
+         return NULL;
+     }
+ #if LEAK_TRACKER_TRACK
+     if (__atomic_load_n(&budgets_active, __ATOMIC_RELAXED) && !budget_allows(site, size, NULL)) {
+         return NULL;
+     }
+ #endif
+     if (size <= SIZE_MAX - REDZONE_BYTES) {
+         ptr = malloc(size + REDZONE_BYTES);
      }
-     void* ptr = malloc(size);
      if (!ptr) {
-         fprintf(stderr, "leak_tracker: malloc(%zu) failed at %s:%d\n", size, file, line);
+         fprintf(stderr, "leak_tracker: malloc(%zu) failed at %s:%d\n",
+                 size, site->file, site->line);
          return NULL;
      }
-     record_allocation(ptr, size, file, line);
+     redzone_fill(ptr, size);
+     OVERHEAD_BEGIN(oh);
+     pthread_mutex_lock(&tracker_lock);
+     slow_path_enter(1);
+ #if LEAK_TRACKER_TRACK
+     if (slow_path_tracks()) {
+         PERF_SPAN(span);
+         PERF_BEGIN(span);
+         record_allocation(ptr, size, site);
+         PERF_END(span);
+         PERF_COMMIT(span, PERF_OP_ALLOC, 1);
+     } else {
+         // Counting mode: counted on the thread, as on the fast path
+         lt_tls.alloc_calls++;
+         lt_tls.bytes_allocated += size;
+         lt_usable_count(site, ptr, &lt_tls.usable_allocated);
+     }
+ #else
+     total_alloc_calls++;
+     total_bytes_allocated += size;
+     lt_usable_count(site, ptr, &lt_tls.usable_allocated);
+ #endif
+     pthread_mutex_unlock(&tracker_lock);
+     OVERHEAD_END(oh);
      return ptr;
  }
  
  /* -------------------------------------------------------------------
-  * my_calloc
+  * calloc slow path
   * -------------------------------------------------------------------
   */
- void* my_calloc(size_t nmemb, size_t size, const char* file, int line) {
-     if (!atexit_registered) {
-         register_leak_report();
+ void* lt_calloc_slow(size_t nmemb, size_t size, lt_site* site) {
+     size_t total;
+     void* ptr = NULL;
+     if (__atomic_load_n(&faults_active, __ATOMIC_RELAXED) &&
+         fault_inject(site, __builtin_mul_overflow(nmemb, size, &total) ? SIZE_MAX : total)) {
+         return NULL;
+     }
+ #if LEAK_TRACKER_TRACK
+     if (!__builtin_mul_overflow(nmemb, size, &total) &&
+         __atomic_load_n(&budgets_active, __ATOMIC_RELAXED) && !budget_allows(site, total, NULL)) {
+         return NULL;
+     }
+ #endif
+     if (!__builtin_mul_overflow(nmemb, size, &total) && total <= SIZE_MAX - REDZONE_BYTES) {
+         // With redzones the guard bytes must come after the whole array
+         ptr = REDZONE_BYTES ? calloc(1, total + REDZONE_BYTES) : calloc(nmemb, size);
      }
-     void* ptr = calloc(nmemb, size);
      if (!ptr) {
          fprintf(stderr, "leak_tracker: calloc(%zu,%zu) failed at %s:%d\n",
-                 nmemb, size, file, line);
+                 nmemb, size, site->file, site->line);
          return NULL;
      }
-     record_allocation(ptr, nmemb * size, file, line);
+     redzone_fill(ptr, total);
+     OVERHEAD_BEGIN(oh);
+     pthread_mutex_lock(&tracker_lock);
+     slow_path_enter(1);
+ #if LEAK_TRACKER_TRACK
+     if (slow_path_tracks()) {
+         PERF_SPAN(span);
+         PERF_BEGIN(span);
+         record_allocation(ptr, total, site);
+         PERF_END(span);
+         PERF_COMMIT(span, PERF_OP_ALLOC, 1);
+     } else {
+         // Counting mode: counted on the thread, as on the fast path
+         lt_tls.alloc_calls++;
+         lt_tls.bytes_allocated += total;
+         lt_usable_count(site, ptr, &lt_tls.usable_allocated);
+     }
+ #else
+     total_alloc_calls++;
+     total_bytes_allocated += total;
+     lt_usable_count(site, ptr, &lt_tls.usable_allocated);
+ #endif
+     pthread_mutex_unlock(&tracker_lock);
+     OVERHEAD_END(oh);
      return ptr;
  }
  
@@ -207,98 +3944,201 @@
   * my_realloc
   * -------------------------------------------------------------------
   */
- void* my_realloc(void* ptr, size_t size, const char* file, int line) {
-     if (!atexit_registered) {
-         register_leak_report();
-     }
- 
+ void* my_realloc(void* ptr, size_t size, lt_site* site) {
+ #if LEAK_TRACKER_TRACK
+     const char* file = site->file;
+     int         line = site->line;
      if (ptr == NULL) {
          // Behaves like malloc(size)
-         void* newptr = malloc(size);
-         if (!newptr) {
-             fprintf(stderr, "leak_tracker: realloc(NULL,%zu) failed at %s:%d\n",
-                     size, file, line);
-             return NULL;
-         }
-         record_allocation(newptr, size, file, line);
-         return newptr;
+         return my_malloc(size, site);
      }
  
+     lt_site_count(site, size);
      if (size == 0) {
          // Behaves like free(ptr)
-         my_free(ptr, file, line);
+         lt_free_slow(ptr, site);
          return NULL;
      }
  
+     if (__atomic_load_n(&faults_active, __ATOMIC_RELAXED) && fault_inject(site, size)) {
+         return NULL;                    // like a failed realloc: the old block stays
+     }
+ 
+     // A block may only grow within its budgets; on refusal it stays as it was
+     if (__atomic_load_n(&budgets_active, __ATOMIC_RELAXED)) {
+         AllocInfo cur;
+         pthread_mutex_lock(&tracker_lock);
+         size_t i = table_find(ptr);
+         int known = i != SIZE_MAX && rec_is_live(&block_table[i]);
+         if (known) {
+             cur = rec_unpack(&block_table[i]);
+         }
+         pthread_mutex_unlock(&tracker_lock);
+         if (known && size > cur.size && !budget_allows(site, size, &cur)) {
+             return NULL;
+         }
+     }
+ 
      // Check if ptr is in active allocations
-     size_t old_size = 0;
-     int found = remove_allocation_node(ptr, &old_size);
+     AllocInfo old;
+     SavedRec  saved;
+     OVERHEAD_BEGIN(oh);
+     pthread_mutex_lock(&tracker_lock);
+     slow_path_enter(0);
+     PERF_SPAN(span);
+     PERF_BEGIN(span);
+     int found = save_record(ptr, &saved) && remove_allocation_node(ptr, &old);
+     PERF_END(span);
      if (!found) {
-         // ptr not found in active list → either double‐free or invalid free
-         if (is_in_freed_list(ptr)) {
-             double_free_count++;
-             fprintf(stderr,
-                     "leak_tracker WARNING: double-free of pointer %p at %s:%d\n",
-                     ptr, file, line);
-         } else {
-             invalid_free_count++;
-             fprintf(stderr,
-                     "leak_tracker WARNING: realloc on untracked pointer %p at %s:%d\n",
-                     ptr, file, line);
+         // ptr not found in active list → either double‐free or invalid free,
+         // unless sampling skipped it: then it stays untracked
+         int untracked = report_bad_free(ptr, "realloc on", file, line);
+         if (untracked) {
+             lt_tls.alloc_calls++;
+             lt_tls.bytes_allocated += size;
+         }
+         pthread_mutex_unlock(&tracker_lock);
+         OVERHEAD_END(oh);
+         if (!untracked) {
+             return NULL;                // libc would abort on it: leave it alone
          }
-         // Still attempt real realloc (though pointer is suspect)
-         return realloc(ptr, size);
+         size_t old_usable = lt_count_usable ? malloc_usable_size(ptr) : 0;
+         void* newptr = realloc(ptr, size);
+         usable_realloc(site, old_usable, newptr, size);
+         return lt_untracked(newptr);
      }
+     redzone_check(&old, "realloc", file, line);
+     pthread_mutex_unlock(&tracker_lock);
+     OVERHEAD_END(oh);
  
      // Perform real realloc
-     void* newptr = realloc(ptr, size);
+     void* newptr = NULL;
+     if (size <= SIZE_MAX - REDZONE_BYTES) {
+         newptr = realloc(ptr, size + REDZONE_BYTES);
+     }
      if (!newptr) {
          fprintf(stderr, "leak_tracker: realloc(%p,%zu) failed at %s:%d\n",
                  ptr, size, file, line);
-         // Since old ptr was removed, we lost that record. User must handle manually.
+         // The old block is still the caller's: track it again
+         pthread_mutex_lock(&tracker_lock);
+         restore_allocation(&saved);
+         pthread_mutex_unlock(&tracker_lock);
          return NULL;
      }
+     redzone_fill(newptr, size);
  
      // Record the new allocation and move old ptr into freed list
-     add_to_freed_list(ptr);
-     record_allocation(newptr, size, file, line);
-     total_bytes_freed += old_size;
+     OVERHEAD_BEGIN(oh2);
+     pthread_mutex_lock(&tracker_lock);
+     cross_free_record(&old);
+     site_pair_record(&old, site);
+     PERF_BEGIN(span);
+     add_to_freed_list(old.ptr, old.site, site);
+     record_allocation(newptr, size, site);
+     PERF_END(span);
+     PERF_COMMIT(span, PERF_OP_REALLOC, 2);
+     total_bytes_freed += old.size;
+     pthread_mutex_unlock(&tracker_lock);
+     OVERHEAD_END(oh2);
+     return newptr;
+ #else
+     // Without per-block records only the new size can be counted
+     if (lt_tls.gen == 0) {
+         pthread_mutex_lock(&tracker_lock);
+         slow_path_enter(0);
+         pthread_mutex_unlock(&tracker_lock);
+     }
+     lt_site_count(site, size);
+     if (size && __atomic_load_n(&faults_active, __ATOMIC_RELAXED) && fault_inject(site, size)) {
+         return NULL;
+     }
+     size_t old_usable = lt_count_usable ? malloc_usable_size(ptr) : 0;
+     void* newptr = realloc(ptr, size);
+     usable_realloc(site, old_usable, newptr, size);
+     if (newptr && size) {
+         lt_tls.alloc_calls++;
+         lt_tls.bytes_allocated += size;
+     }
      return newptr;
+ #endif
+ }
+ 
+ /*
+  * A block the fast path did not track has an address that the freed list
+  * still holds: drop that entry so freeing the new block is not reported as
+  * a double free.
+  */
+ void lt_reuse_slow(void* ptr) {
+ #if LEAK_TRACKER_TRACK
+     pthread_mutex_lock(&tracker_lock);
+     remove_from_freed_list(ptr);
+     pthread_mutex_unlock(&tracker_lock);
+ #else
+     (void)ptr;
+ #endif
  }
  
  /* -------------------------------------------------------------------
-  * my_free
+  * free slow path
   * -------------------------------------------------------------------
   */
- void my_free(void* ptr, const char* file, int line) {
+ void lt_free_slow(void* ptr, lt_site* site) {
+ #if LEAK_TRACKER_TRACK
+     const char* file = site->file;
+     int         line = site->line;
+     OVERHEAD_BEGIN(oh);
+     pthread_mutex_lock(&tracker_lock);
+     slow_path_enter(0);
      total_free_calls++;
  
      if (ptr == NULL) {
+         pthread_mutex_unlock(&tracker_lock);
+         OVERHEAD_END(oh);
          return;  // free(NULL) is no-op
      }
  
      // Try to remove from active allocations
-     size_t block_size = 0;
-     int found = remove_allocation_node(ptr, &block_size);
+     AllocInfo block;
+     PERF_SPAN(span);
+     PERF_BEGIN(span);
+     int found = remove_allocation_node(ptr, &block);
      if (found) {
          // Valid free: record bytes freed and add to freed list
-         total_bytes_freed += block_size;
-         add_to_freed_list(ptr);
+         total_bytes_freed += block.size;
+         add_to_freed_list(ptr, block.site, site);
+         cross_free_record(&block);
+         site_pair_record(&block, site);
+         PERF_END(span);
+         PERF_COMMIT(span, PERF_OP_FREE, 1);
+         redzone_check(&block, "free", file, line);
+         int held = quarantine_hold(ptr, block.size);
+         pthread_mutex_unlock(&tracker_lock);
+         OVERHEAD_END(oh);
+         if (!held) {
+             free(ptr);
+         }
+     } else if (report_bad_free(ptr, "free of", file, line)) {
+         // Block that sampling did not track: release it normally
+         lt_usable_count(site, ptr, &lt_tls.usable_freed);
+         pthread_mutex_unlock(&tracker_lock);
+         OVERHEAD_END(oh);
          free(ptr);
      } else {
          // Not in active list → either double-free or invalid free
-         if (is_in_freed_list(ptr)) {
-             double_free_count++;
-             fprintf(stderr,
-                     "leak_tracker WARNING: double-free of pointer %p at %s:%d\n",
-                     ptr, file, line);
-         } else {
-             invalid_free_count++;
-             fprintf(stderr,
-                     "leak_tracker WARNING: free of untracked pointer %p at %s:%d\n",
-                     ptr, file, line);
-         }
+         pthread_mutex_unlock(&tracker_lock);
+         OVERHEAD_END(oh);
          // Do not call real free on invalid pointers
      }
+ #else
+     // Only reached on a thread's first call; afterwards the fast path counts
+     (void)site;
+     pthread_mutex_lock(&tracker_lock);
+     slow_path_enter(0);
+     total_free_calls++;
+     lt_usable_count(site, ptr, &lt_tls.usable_freed);
+     pthread_mutex_unlock(&tracker_lock);
+     free(ptr);
+ #endif
  }
- 
\ No newline at end of file
+ #endif /* LEAK_TRACKER_ENABLED */
+ 
@@ -2,24 +2,692 @@
 #define LEAK_TRACKER_H
 
 #include <stddef.h>
+#include <stdint.h>
+/*
+ * Pull in the real declarations before the macros below exist, so that a
+ * translation unit including <stdlib.h> after this header still compiles.
+ */
+#include <stdlib.h>
+
+/*
+ * Compile-time configuration. Define these (e.g. -DLEAK_TRACKER_STACKS=1)
+ * identically for src/leak_tracker.c and for the code that includes this
+ * header; whatever is switched off is compiled out of the tracker entirely.
+ *
+ *   LEAK_TRACKER_DISABLE       tracker off: malloc & co. stay the libc calls,
+ *                              tracker_* become no-ops (release builds)
+ *   LEAK_TRACKER_COUNT         call and byte counters                  (1)
+ *   LEAK_TRACKER_TRACK         per-block records: leak list, double and
+ *                              invalid free detection                  (1)
+ *   LEAK_TRACKER_STACKS        call stack of every tracked allocation  (0)
+ *   LEAK_TRACKER_STACK_DEPTH   frames kept per allocation              (8)
+ *   LEAK_TRACKER_REDZONES      guard bytes after every tracked block,
+ *                              checked on free/realloc and at exit     (0)
+ *   LEAK_TRACKER_REDZONE_SIZE  guard bytes per block                   (16)
+ *
+ * What the compiled-in features do at run time (tracking mode, sample
+ * rate, report detail and destination, quarantine, stack depth) is set
+ * with LEAK_TRACKER_OPTIONS in the environment; see leak_tracker.c.
+ */
+#ifdef LEAK_TRACKER_DISABLE
+#undef  LEAK_TRACKER_COUNT
+#undef  LEAK_TRACKER_TRACK
+#undef  LEAK_TRACKER_STACKS
+#undef  LEAK_TRACKER_REDZONES
+#define LEAK_TRACKER_COUNT      0
+#define LEAK_TRACKER_TRACK      0
+#define LEAK_TRACKER_STACKS     0
+#define LEAK_TRACKER_REDZONES   0
+#endif
+#ifndef LEAK_TRACKER_COUNT
+#define LEAK_TRACKER_COUNT      1
+#endif
+#ifndef LEAK_TRACKER_TRACK
+#define LEAK_TRACKER_TRACK      1
+#endif
+#ifndef LEAK_TRACKER_STACKS
+#define LEAK_TRACKER_STACKS     0
+#endif
+#ifndef LEAK_TRACKER_STACK_DEPTH
+#define LEAK_TRACKER_STACK_DEPTH 8
+#endif
+#ifndef LEAK_TRACKER_REDZONES
+#define LEAK_TRACKER_REDZONES   0
+#endif
+#ifndef LEAK_TRACKER_REDZONE_SIZE
+#define LEAK_TRACKER_REDZONE_SIZE 16
+#endif
+
+#if LEAK_TRACKER_TRACK && !LEAK_TRACKER_COUNT
+#error "LEAK_TRACKER_TRACK requires LEAK_TRACKER_COUNT"
+#endif
+#if (LEAK_TRACKER_STACKS || LEAK_TRACKER_REDZONES) && !LEAK_TRACKER_TRACK
+#error "LEAK_TRACKER_STACKS and LEAK_TRACKER_REDZONES require LEAK_TRACKER_TRACK"
+#endif
+
+/* With every feature off the wrappers would only forward, so skip them */
+#define LEAK_TRACKER_ENABLED    (LEAK_TRACKER_COUNT || LEAK_TRACKER_TRACK)
+
+#if LEAK_TRACKER_ENABLED
+#include <malloc.h>     // malloc_usable_size(), for counting mode
+#endif
+
+/* Symbols exported from libleaktracker (built with -fvisibility=hidden) */
+#if defined(__GNUC__)
+#define LT_API __attribute__((visibility("default")))
+#else
+#define LT_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * One descriptor per call site. The malloc/calloc/realloc/free macros
+ * define it as a static object in the "lt_sites" section and pass its
+ * address, so the tracker never hashes file/line and can walk every site
+ * in the program, including ones that never leaked. The counters belong
+ * to the tracker; 'calls', 'bytes' and 'usable_bytes' are added up per
+ * thread on the fast path (lt_site_batch) and moved here before they are
+ * read, the rest is updated under the tracker lock. 128 bytes, so the
+ * section is a plain array.
+ */
+enum { LT_SITE_MALLOC, LT_SITE_CALLOC, LT_SITE_REALLOC, LT_SITE_FREE };
+
+typedef struct __attribute__((aligned(64))) lt_site {
+    const char* file;
+    int         line;
+    unsigned    id;              // 1-based, assigned when the module registers
+    unsigned short kind;         // LT_SITE_*
+    unsigned short budget;       // tracker's budget slot + 1, 0 = none
+    size_t      calls;           // every call through this site
+    size_t      bytes;           // bytes requested here
+    size_t      usable_bytes;    // counting mode: malloc_usable_size() bytes allocated
+                                 // here, or released here at a free site
+    size_t      tracked_blocks;  // allocations recorded with this site
+    size_t      freed_blocks;    // ... of which freed again (from any site)
+    size_t      live_bytes;      // bytes of those still allocated
+} lt_site;
+
+#if LEAK_TRACKER_ENABLED
+#define LT_SITE(kind) (__extension__ ({                                          \
+        static lt_site lt_site_here_                                            \
+            __attribute__((section("lt_sites"), used, aligned(64))) =           \
+            { __FILE__, __LINE__, 0, (kind), 0, 0, 0, 0, 0, 0, 0 };             \
+        &lt_site_here_; }))
+
+/*
+ * Every translation unit registers its module's lt_sites section once at
+ * load time (the tracker ignores repeats). The bounds are provided by the
+ * linker; they are weak so a module without sites still links.
+ */
+extern lt_site __start_lt_sites[] __attribute__((weak, visibility("hidden")));
+extern lt_site __stop_lt_sites[]  __attribute__((weak, visibility("hidden")));
+LT_API void lt_register_sites(lt_site* begin, lt_site* end);
+
+__attribute__((constructor, unused))
+static void lt_register_module_sites(void) {
+    lt_register_sites(__start_lt_sites, __stop_lt_sites);
+}
+
+/*
+ * Out-of-line slow paths in leak_tracker.c. They record the allocation
+ * (or look the pointer up), update the shared counters under the tracker
+ * lock and re-arm the calling thread's sampling countdown.
+ */
+LT_API void* lt_malloc_slow(size_t size, lt_site* site);
+LT_API void* lt_calloc_slow(size_t nmemb, size_t size, lt_site* site);
+LT_API void  lt_free_slow(void* ptr, lt_site* site);
+LT_API void  lt_reuse_slow(void* ptr);   // untracked block landed on a known address
+
+/*
+ * Per-site counts on their way to the lt_site. Each thread adds to a small
+ * direct-mapped cache of its own, so calls from many threads through one
+ * site never share a cache line. The '_done' parts have been moved to the
+ * site already. The owner moves the rest when a slot changes site and at
+ * thread exit, the tracker before reading the counts; both hold the
+ * thread's batch_lock for that, the increments need no lock.
+ */
+#define LT_SITE_BATCH   8
+
+typedef struct lt_site_batch {
+    lt_site*      site;
+    size_t        calls;
+    size_t        bytes;
+    size_t        usable_bytes;
+    size_t        calls_done;
+    size_t        bytes_done;
+    size_t        usable_done;
+} lt_site_batch;
+
+LT_API void  lt_site_switch(lt_site_batch* b, lt_site* site);   // slot b now counts for site
+
+/*
+ * State read by the inline fast paths below; owned by leak_tracker.c.
+ * An allocation takes the fast path while the thread's countdown has not
+ * run out and the configuration has not changed since it was armed; it is
+ * then only counted on the thread. A free takes the fast path when
+ * sampling is on and the pointer's filter slot shows that no tracked or
+ * freed-and-remembered block hashes there. Both need the thread to have
+ * registered on a slow path.
+ */
+typedef struct lt_thread_state {
+    long          countdown;       // calls until the next tracked allocation
+    unsigned      gen;             // lt_config_gen the countdown was armed under
+    size_t        alloc_calls;     // allocations that took the fast path
+    size_t        bytes_allocated;
+    size_t        free_calls;      // frees that took the fast path
+    size_t        usable_allocated; // counting mode: malloc_usable_size() totals
+    size_t        usable_freed;
+    struct lt_thread_state* next;  // registry link, owned by leak_tracker.c
+    unsigned char batch_lock;      // guards moving 'batch' into the sites
+    lt_site_batch batch[LT_SITE_BATCH];
+} lt_thread_state;
+
+#define LT_FILTER_BITS  16
+
+extern LT_API __thread lt_thread_state lt_tls;
+extern LT_API unsigned      lt_config_gen;                    // bumped on config changes
+extern LT_API unsigned char lt_free_fast;                     // untracked frees may skip the lookup
+extern LT_API unsigned char lt_count_usable;                  // counting mode: add up usable sizes
+extern LT_API unsigned char lt_filter[1u << LT_FILTER_BITS];  // known blocks per slot (255 = many)
+
+#define LT_LIKELY(x)    __builtin_expect(!!(x), 1)
+#define LT_UNLIKELY(x)  __builtin_expect(!!(x), 0)
+
+static inline size_t lt_filter_slot(const void* ptr) {
+    return (size_t)((((uint64_t)(uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15ULL)
+                    >> (64 - LT_FILTER_BITS));
+}
+
+/* The calling thread's batch slot for site */
+static inline lt_site_batch* lt_site_slot(lt_site* site) {
+    lt_site_batch* b = &lt_tls.batch[((uintptr_t)site / sizeof(lt_site)) & (LT_SITE_BATCH - 1)];
+    if (LT_UNLIKELY(b->site != site)) {
+        lt_site_switch(b, site);
+    }
+    return b;
+}
+
+/*
+ * Per-site call and byte counts, kept for every call. Only this thread
+ * writes the slot; the stores are atomic so the tracker reads whole values.
+ */
+static inline void lt_site_count(lt_site* site, size_t bytes) {
+    lt_site_batch* b = lt_site_slot(site);
+    __atomic_store_n(&b->calls, b->calls + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&b->bytes, b->bytes + bytes, __ATOMIC_RELAXED);
+}
+
+/* Usable bytes allocated at, or released at, a site (modulo 2^64) */
+static inline void lt_site_usable(lt_site* site, size_t n) {
+    lt_site_batch* b = lt_site_slot(site);
+    __atomic_store_n(&b->usable_bytes, b->usable_bytes + n, __ATOMIC_RELAXED);
+}
+
+/*
+ * Counting mode keeps no per-block records, so a free cannot know the
+ * size that was requested. Both sides count what the allocator reports
+ * instead, which balances exactly: per thread, and per call site.
+ */
+static inline void lt_usable_count(lt_site* site, void* ptr, size_t* total) {
+    if (LT_UNLIKELY(__atomic_load_n(&lt_count_usable, __ATOMIC_RELAXED)) && ptr) {
+        size_t n = malloc_usable_size(ptr);
+        lt_site_usable(site, n);
+        *total += n;
+    }
+}
+
+/* Sampling decision: 1 if this allocation is only counted, not tracked */
+static inline int lt_skip_tracking(void) {
+    lt_thread_state* t = &lt_tls;
+    return t->gen == __atomic_load_n(&lt_config_gen, __ATOMIC_RELAXED) && --t->countdown > 0;
+}
+
+/* An untracked block may reuse a freed address the tracker still remembers */
+static inline void* lt_untracked(void* ptr) {
+    if (LT_UNLIKELY(ptr && __atomic_load_n(&lt_filter[lt_filter_slot(ptr)], __ATOMIC_RELAXED))) {
+        lt_reuse_slow(ptr);
+    }
+    return ptr;
+}
 
 /*
  * Public prototypes for our custom allocation functions.
  * Each wrapper takes the same arguments as the real allocator,
- * plus file/line for reporting.
+ * plus the call site descriptor (LT_SITE) for reporting.
+ */
+static inline void* my_malloc(size_t size, lt_site* site) {
+    lt_site_count(site, size);
+    if (LT_LIKELY(lt_skip_tracking())) {
+        void* ptr = malloc(size);
+        lt_tls.alloc_calls++;
+        lt_tls.bytes_allocated += size;
+        lt_usable_count(site, ptr, &lt_tls.usable_allocated);
+        return lt_untracked(ptr);
+    }
+    return lt_malloc_slow(size, site);
+}
+
+static inline void* my_calloc(size_t nmemb, size_t size, lt_site* site) {
+    size_t total;
+    int overflow = __builtin_mul_overflow(nmemb, size, &total);
+    lt_site_count(site, overflow ? 0 : total);
+    if (LT_LIKELY(!overflow && lt_skip_tracking())) {
+        void* ptr = calloc(nmemb, size);
+        lt_tls.alloc_calls++;
+        lt_tls.bytes_allocated += total;
+        lt_usable_count(site, ptr, &lt_tls.usable_allocated);
+        return lt_untracked(ptr);
+    }
+    return lt_calloc_slow(nmemb, size, site);
+}
+
+static inline void my_free(void* ptr, lt_site* site) {
+    lt_site_count(site, 0);
+    if (LT_LIKELY(lt_tls.gen == __atomic_load_n(&lt_config_gen, __ATOMIC_RELAXED) &&
+                  __atomic_load_n(&lt_free_fast, __ATOMIC_RELAXED) &&
+                  !__atomic_load_n(&lt_filter[lt_filter_slot(ptr)], __ATOMIC_RELAXED))) {
+        lt_tls.free_calls++;
+        lt_usable_count(site, ptr, &lt_tls.usable_freed);
+        free(ptr);
+        return;
+    }
+    lt_free_slow(ptr, site);
+}
+
+/* realloc has to look the old block up, so it is always out of line */
+LT_API void* my_realloc(void* ptr, size_t size, lt_site* site);
+#else
+#define LT_SITE(kind) ((lt_site*)0)
+
+static inline void* my_malloc(size_t size, lt_site* site) {
+    (void)site;
+    return malloc(size);
+}
+static inline void* my_calloc(size_t nmemb, size_t size, lt_site* site) {
+    (void)site;
+    return calloc(nmemb, size);
+}
+static inline void* my_realloc(void* ptr, size_t size, lt_site* site) {
+    (void)site;
+    return realloc(ptr, size);
+}
+static inline void my_free(void* ptr, lt_site* site) {
+    (void)site;
+    free(ptr);
+}
+#endif /* LEAK_TRACKER_ENABLED */
+
+/*
+ * Introspection for tests and tools.
+ * tracker_get_stats() fills a snapshot of the global counters.
+ * tracker_foreach_live() calls fn once for every allocation that is still
+ * live; the tracker lock is held during the walk, so fn must not call the
+ * wrappers (malloc/free through the macros) itself.
+ * tracker_foreach_site() calls fn once for every call site of every
+ * registered module, in id order, under the same lock.
+ */
+typedef struct tracker_stats {
+    size_t alloc_calls;       // malloc/calloc/realloc calls recorded
+    size_t free_calls;        // free calls, including free(NULL)
+    size_t bytes_allocated;
+    size_t bytes_freed;
+    size_t double_frees;
+    size_t invalid_frees;
+    size_t live_blocks;       // allocations not yet freed
+    size_t live_bytes;
+    size_t redzone_overflows; // blocks whose guard bytes were overwritten
+    size_t budget_denials;    // allocations refused by a budget
+    size_t cross_thread_frees; // blocks freed on another thread than their allocator
+    size_t usable_live_bytes; // counting mode: malloc_usable_size() allocated - freed, else 0
+} tracker_stats;
+
+typedef void (*tracker_live_fn)(void* ptr, size_t size, const char* file, int line, void* ctx);
+typedef void (*tracker_site_fn)(const lt_site* site, void* ctx);
+
+LT_API void tracker_get_stats(tracker_stats* out);
+LT_API void tracker_foreach_live(tracker_live_fn fn, void* ctx);
+LT_API void tracker_foreach_site(tracker_site_fn fn, void* ctx);
+
+/*
+ * The live tracked block containing addr, which may point anywhere inside
+ * it: returns 1 and fills *out, or 0. For naming wild pointers and for
+ * interior-pointer scans of the heap. The first call builds a B-tree of
+ * the live blocks' start addresses; from then on every tracked malloc
+ * and free keeps it current and each lookup is O(log n).
+ */
+typedef struct tracker_block {
+    void*       ptr;          // start of the block
+    size_t      size;
+    const char* file;         // allocation site
+    int         line;
+    unsigned    tag;
+    unsigned    thread;
+} tracker_block;
+
+LT_API int  tracker_find_block(const void* addr, tracker_block* out);
+
+/*
+ * Track one allocation in every n on average (1 = every allocation, the
+ * default). Untracked allocations are still counted but never reported
+ * as leaks, and with n > 1 frees of unknown pointers are assumed to
+ * belong to them rather than reported as invalid.
+ */
+LT_API void tracker_set_sample_interval(unsigned long n);
+
+/*
+ * Tracking mode, switchable while the program runs (also from outside,
+ * with the mode_signal and control_file options of LEAK_TRACKER_OPTIONS):
+ *   LT_MODE_COUNT   no block records, counters and usable bytes per site
+ *   LT_MODE_SAMPLE  one allocation in the last sample interval set (64)
+ *   LT_MODE_FULL    every allocation tracked, the default
+ * Blocks allocated under a cheaper mode stay unknown after a switch:
+ * their frees go to libc unreported, a realloc under LT_MODE_FULL starts
+ * tracking them, and they never show up as leaks. tracker_set_mode()
+ * returns 0, or -1 if the mode is not compiled in (LEAK_TRACKER_TRACK=0
+ * only has LT_MODE_COUNT); tracker_get_mode() returns -1 when the tracker
+ * is compiled out.
+ */
+enum { LT_MODE_COUNT, LT_MODE_SAMPLE, LT_MODE_FULL };
+LT_API int  tracker_set_mode(int mode);
+LT_API int  tracker_get_mode(void);
+
+/*
+ * Overhead budget in percent of the allocating threads' time, e.g. 2.0
+ * (LEAK_TRACKER_OPTIONS overhead=2%). The slow paths time their own work
+ * with the cycle counter; while the share is over the budget, sampling
+ * becomes sparser by powers of two on top of the mode asked for, and
+ * comes back as the load drops. The inline fast path is not measured.
+ * 0 turns the controller off. Needs LEAK_TRACKER_TRACK.
+ */
+LT_API void tracker_set_overhead_budget(double percent);
+
+/*
+ * Allocation budgets (need LEAK_TRACKER_TRACK). tracker_set_budget() caps
+ * the bytes held by all tracked blocks; tracker_set_site_budget() caps the
+ * blocks allocated at one call site, or at every site of a file when line
+ * is 0 ('file' may be a trailing part of the path, e.g. "cache.c"). Bytes
+ * 0 lifts a cap. An allocation that would go over a cap returns NULL with
+ * a warning, unless the handler returns nonzero to let it through. While
+ * a cap is set every allocation is tracked, whatever the sample interval.
+ * tracker_set_site_budget() returns -1 when its table (32 entries) is full.
  */
-void* my_malloc(size_t size, const char* file, int line);
-void* my_calloc(size_t nmemb, size_t size, const char* file, int line);
-void* my_realloc(void* ptr, size_t size, const char* file, int line);
-void  my_free(void* ptr, const char* file, int line);
+typedef int (*tracker_budget_fn)(const lt_site* site, size_t size,
+                                 size_t limit, size_t in_use, void* ctx);
+
+LT_API void tracker_set_budget(size_t bytes);
+LT_API int  tracker_set_site_budget(const char* file, int line, size_t bytes);
+LT_API void tracker_set_budget_handler(tracker_budget_fn fn, void* ctx);
+
+/*
+ * Fault injection for exercising out-of-memory paths. While a rule is set
+ * every allocation through the wrappers gets a sequence number, and
+ * malloc/calloc/realloc return NULL (errno ENOMEM) when:
+ *   tracker_fail_nth(n)          it is the nth allocation after this call
+ *                                (0 turns the rule off)
+ *   tracker_fail_sites(f, l, p, seed)
+ *                                it comes from a site matching f/l (as for
+ *                                budgets) and a PRNG seeded with 'seed'
+ *                                draws below p; returns the rule number
+ *                                (1, 2, ...) or -1 when 16 rules are set
+ * The same program, rules and seeds fail the same allocations again.
+ * Every failure is announced on stderr and logged (the first 64 are kept
+ * for tracker_get_injections() and the report), with the sequence number
+ * and the rule that fired: 0 for the nth rule, otherwise the rule number.
+ * tracker_fail_clear() drops all rules, the log and the sequence count.
+ */
+typedef struct tracker_injection {
+    unsigned long  seq;    // allocation number since injection was turned on
+    const lt_site* site;
+    size_t         size;
+    int            rule;
+} tracker_injection;
+
+LT_API void   tracker_fail_nth(unsigned long n);
+LT_API int    tracker_fail_sites(const char* file, int line, double p, uint64_t seed);
+LT_API void   tracker_fail_clear(void);
+LT_API size_t tracker_get_injections(tracker_injection* out, size_t max);
+
+/*
+ * Allocation tags (need LEAK_TRACKER_TRACK). A tag from 1 to 255 names
+ * the subsystem that owns memory (cache, parser, ...); 0 is "untagged".
+ * Each thread has a current tag, stored with every block it allocates,
+ * and the report and tracker_get_tag_stats() break tracked memory down
+ * by tag. With sampling on, only sampled blocks are counted.
+ *   tracker_set_tag(t)        set the thread's tag, returns the previous
+ *   TRACKER_TAG_SCOPE(t);     set it until the enclosing block is left
+ *   tracker_name_tag(t, s)    label used in the report
+ *   tracker_set_tag_budget(t, bytes)
+ *                             byte cap on the tag's live blocks, see
+ *                             tracker_set_budget()
+ */
+#define LT_MAX_TAGS 256
+
+typedef struct tracker_tag_stats {
+    size_t alloc_calls;       // tracked allocations made under the tag
+    size_t bytes_allocated;
+    size_t live_blocks;
+    size_t live_bytes;
+} tracker_tag_stats;
+
+LT_API unsigned tracker_set_tag(unsigned tag);
+LT_API void     tracker_name_tag(unsigned tag, const char* name);
+LT_API void     tracker_get_tag_stats(unsigned tag, tracker_tag_stats* out);
+LT_API void     tracker_set_tag_budget(unsigned tag, size_t bytes);
+
+/*
+ * Per-thread attribution (needs LEAK_TRACKER_TRACK). Every tracked block
+ * records the id of the thread that allocated it: 1, 2, ... in the order
+ * threads first use the tracker, reused after a thread exits. When a
+ * thread exits, blocks it allocated that are still live move to id 0
+ * ("exited threads"; also used once 4095 threads are alive), and with
+ * tracker_set_thread_exit_report(1) they are listed on stderr first.
+ * tracker_get_thread_stats() reads one id's counters.
+ */
+#define LT_MAX_THREADS 4096
+
+typedef struct tracker_thread_stats {
+    size_t alloc_calls;       // tracked allocations by the thread
+    size_t bytes_allocated;
+    size_t live_blocks;
+    size_t live_bytes;
+} tracker_thread_stats;
+
+LT_API unsigned tracker_thread_id(void);
+LT_API void     tracker_get_thread_stats(unsigned id, tracker_thread_stats* out);
+LT_API void     tracker_set_thread_exit_report(int on);
+
+/*
+ * Cross-thread frees: tracked blocks freed or reallocated on another
+ * thread than the one that allocated them, summed per (allocating
+ * thread, freeing thread, allocation site). Thread ids are those of
+ * tracker_thread_id() at the time, so a reused id merges two threads.
+ * The table keeps 768 pairs; later pairs only reach the totals in
+ * tracker_stats.cross_thread_frees.
+ */
+typedef struct tracker_cross_free {
+    unsigned       alloc_thread;
+    unsigned       free_thread;
+    const lt_site* site;      // where the blocks were allocated
+    size_t         blocks;
+    size_t         bytes;
+} tracker_cross_free;
+
+typedef void (*tracker_cross_free_fn)(const tracker_cross_free* pair, void* ctx);
+
+LT_API void     tracker_foreach_cross_free(tracker_cross_free_fn fn, void* ctx);
+
+/*
+ * Ownership map (needs LEAK_TRACKER_TRACK): tracked blocks released per
+ * (allocation site, release site), the release site being the free or
+ * realloc call that ended the block. tracker_foreach_site_pair() visits
+ * every pair under the tracker lock; the table keeps 1536 pairs.
+ */
+typedef struct tracker_site_pair {
+    const lt_site* alloc_site;
+    const lt_site* free_site;
+    size_t         blocks;
+    size_t         bytes;
+} tracker_site_pair;
+
+typedef void (*tracker_site_pair_fn)(const tracker_site_pair* pair, void* ctx);
+
+LT_API void     tracker_foreach_site_pair(tracker_site_pair_fn fn, void* ctx);
+
+/*
+ * Crash report: tracker_set_crash_report(1) installs handlers for
+ * SIGSEGV, SIGBUS, SIGFPE, SIGILL and SIGABRT (on an alternate stack per
+ * thread, set up on its next call into the tracker) that write the
+ * counters and the live blocks per call site and per tag using write(2)
+ * only, then pass the signal on to the previous handler.
+ * The report goes to stderr, or to <dir>/leak_tracker.<pid>.crash when
+ * LEAK_TRACKER_OUTPUT_DIR is set. 0 restores the previous handlers.
+ */
+LT_API void     tracker_set_crash_report(int on);
+
+/*
+ * Metadata file (needs LEAK_TRACKER_TRACK). tracker_set_metadata_file(),
+ * or LEAK_TRACKER_METADATA_FILE=<path> in the environment at startup,
+ * moves the block table and the leak counters into a shared mapping of
+ * that file. The file stays current even if the process is SIGKILLed
+ * (by the OOM killer, say), and tools/lt-inspect reads the live heap
+ * back from it. "%p" in the path is replaced by the pid, so a forked child
+ * gets a file of its own; without it the child stops writing to the
+ * parent's file. NULL moves the table back to anonymous memory. Returns
+ * -1 if the file cannot be created.
+ *
+ * File layout (native byte order and word size, offsets from the start):
+ *   lt_meta_header    at 0
+ *   lt_meta_site[]    site_cap entries at site_off, site_count in use
+ *   lt_meta_record[]  block_cap slots at block_off: an open-addressing
+ *                     table, empty slots have ptr 0, freed pointers
+ *                     kept for double-free checks have LT_META_FREED
+ * A record's site is the address of an lt_site in the process; the site
+ * entry with the same addr names it. While the table moves to a bigger
+ * slot array, 'epoch' is odd.
+ */
+#define LT_META_MAGIC      "LTMETA1"
+#define LT_META_VERSION    1
+#define LT_META_RUNNING    1
+#define LT_META_EXITED     2
+#define LT_META_SIZE_MASK  ((UINT64_C(1) << 40) - 1)
+#define LT_META_TAG(m)     ((unsigned)((m) >> 40) & 0xFF)
+#define LT_META_THREAD(m)  ((unsigned)((m) >> 48) & 0xFFF)
+#define LT_META_INHERITED  (UINT64_C(1) << 62)
+#define LT_META_FREED      (UINT64_C(1) << 63)
+
+typedef struct lt_meta_header {
+    char     magic[8];        // LT_META_MAGIC
+    uint32_t version;         // LT_META_VERSION
+    uint32_t state;           // LT_META_RUNNING, LT_META_EXITED
+    uint64_t pid;
+    uint64_t epoch;
+    uint64_t site_off, site_cap, site_count;
+    uint64_t block_off, block_cap, block_used;
+    uint64_t alloc_calls;     // tracked allocations
+    uint64_t bytes_allocated; // ... and their bytes
+    uint64_t bytes_freed;
+    uint64_t live_blocks;
+    uint64_t live_bytes;
+    uint64_t double_frees;
+    uint64_t invalid_frees;
+} lt_meta_header;
+
+typedef struct lt_meta_site {
+    uint64_t addr;            // lt_site address the records point to
+    uint32_t line;
+    uint32_t kind;            // LT_SITE_*
+    char     file[240];       // truncated to fit
+} lt_meta_site;
+
+typedef struct lt_meta_record {
+    uint64_t ptr;
+    uint64_t site;
+    uint64_t meta;            // size (LT_META_SIZE_MASK), tag, thread, flags
+} lt_meta_record;
+
+LT_API int      tracker_set_metadata_file(const char* path);
+
+/*
+ * Exit report destination: tracker_set_report_file(), or
+ * LEAK_TRACKER_REPORT_FILE=<path> in the environment at startup, sends
+ * the report to that file instead of stdout ("%p" is replaced by the pid,
+ * as above). It takes precedence over LEAK_TRACKER_OUTPUT_DIR. NULL goes
+ * back to the default. The file is only created at exit.
+ */
+LT_API void     tracker_set_report_file(const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define LT_CONCAT_(a, b) a##b
+#define LT_CONCAT(a, b)  LT_CONCAT_(a, b)
+
+#if LEAK_TRACKER_ENABLED
+static inline void lt_tag_restore(unsigned* saved) {
+    tracker_set_tag(*saved);
+}
+#define TRACKER_TAG_SCOPE(tag)                                                  \
+    unsigned LT_CONCAT(lt_saved_tag_, __LINE__)                                 \
+        __attribute__((cleanup(lt_tag_restore), unused)) = tracker_set_tag(tag)
 
 /*
  * Macros to replace the standard functions with our wrappers.
- * __FILE__ and __LINE__ are captured automatically.
+ * Each use gets its own static site descriptor holding __FILE__/__LINE__.
  */
-#define malloc(sz)    my_malloc((sz), __FILE__, __LINE__)
-#define calloc(nm, s) my_calloc((nm), (s), __FILE__, __LINE__)
-#define realloc(p, s) my_realloc((p), (s), __FILE__, __LINE__)
-#define free(p)       my_free((p), __FILE__, __LINE__)
+#define malloc(sz)    my_malloc((sz), LT_SITE(LT_SITE_MALLOC))
+#define calloc(nm, s) my_calloc((nm), (s), LT_SITE(LT_SITE_CALLOC))
+#define realloc(p, s) my_realloc((p), (s), LT_SITE(LT_SITE_REALLOC))
+#define free(p)       my_free((p), LT_SITE(LT_SITE_FREE))
+#else
+/* Tracker compiled out: the introspection calls cost nothing and need no library */
+static inline void lt_disabled_stats(tracker_stats* out) {
+    tracker_stats zero = {0};
+    *out = zero;
+}
+#define tracker_get_stats(out)        lt_disabled_stats(out)
+#define tracker_foreach_live(fn, ctx) ((void)(fn), (void)(ctx))
+#define tracker_foreach_site(fn, ctx) ((void)(fn), (void)(ctx))
+#define tracker_find_block(addr, out) ((void)(addr), (void)(out), 0)
+#define tracker_set_sample_interval(n) ((void)(n))
+#define tracker_set_mode(mode)         ((void)(mode), -1)
+#define tracker_get_mode()             (-1)
+#define tracker_set_overhead_budget(percent) ((void)(percent))
+#define tracker_set_budget(bytes)      ((void)(bytes))
+#define tracker_set_site_budget(file, line, bytes) ((void)(file), (void)(line), (void)(bytes), -1)
+#define tracker_set_budget_handler(fn, ctx)        ((void)(fn), (void)(ctx))
+#define tracker_fail_nth(n)                        ((void)(n))
+#define tracker_fail_sites(file, line, p, seed)    ((void)(file), (void)(line), (void)(p), (void)(seed), -1)
+#define tracker_fail_clear()                       ((void)0)
+#define tracker_get_injections(out, max)           ((void)(out), (void)(max), (size_t)0)
+static inline void lt_disabled_tag_stats(tracker_tag_stats* out) {
+    tracker_tag_stats zero = {0};
+    *out = zero;
+}
+static inline unsigned lt_disabled_set_tag(unsigned tag) {
+    (void)tag;
+    return 0;
+}
+#define tracker_set_tag(tag)                       lt_disabled_set_tag(tag)
+#define tracker_name_tag(tag, name)                ((void)(tag), (void)(name))
+#define tracker_get_tag_stats(tag, out)            ((void)(tag), lt_disabled_tag_stats(out))
+#define tracker_set_tag_budget(tag, bytes)         ((void)(tag), (void)(bytes))
+#define TRACKER_TAG_SCOPE(tag)                     ((void)(tag))
+static inline void lt_disabled_thread_stats(tracker_thread_stats* out) {
+    tracker_thread_stats zero = {0};
+    *out = zero;
+}
+#define tracker_thread_id()                        0u
+#define tracker_get_thread_stats(id, out)          ((void)(id), lt_disabled_thread_stats(out))
+#define tracker_set_thread_exit_report(on)         ((void)(on))
+#define tracker_foreach_cross_free(fn, ctx)        ((void)(fn), (void)(ctx))
+#define tracker_foreach_site_pair(fn, ctx)         ((void)(fn), (void)(ctx))
+#define tracker_set_crash_report(on)               ((void)(on))
+#define tracker_set_metadata_file(path)            ((void)(path), -1)
+#define tracker_set_report_file(path)              ((void)(path))
+#endif
 
 #endif // LEAK_TRACKER_H
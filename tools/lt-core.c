@@ -0,0 +1,395 @@
+// lt-core.c
+//
+// Rebuilds the live heap of a crashed process from its core file, without
+// any tracker code having run at crash time. It looks up the tracker's
+// globals (block_table, block_cap and the counters) in the executable's
+// symbol table, reads the block table out of the core and names each
+// record's call site from the lt_site descriptors (the site's file name
+// comes from the executable when the core leaves read-only data out).
+//
+// The tracker must be linked into the executable (as with run.sh, the
+// benchmarks or libleaktracker.a), and the executable must not be
+// stripped: the globals are static and only .symtab lists them.
+// x86-64 and other 64-bit little-endian ELF targets only.
+//
+// Usage: tools/lt-core [-a] [-n sites] [-x addr]... <executable> <core>
+//
+//   -a         list every live block too
+//   -n sites   call sites to show, largest first (default 20, 0 = all)
+//   -x addr    name the live block containing addr (a wild pointer from
+//              the crash, say); may be repeated
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// The analyzer uses the real allocator; it only needs the record layout
+#ifndef LEAK_TRACKER_DISABLE
+#define LEAK_TRACKER_DISABLE
+#endif
+#include "leak_tracker.h"
+
+typedef struct ElfFile {
+    const char*       path;
+    const char*       data;
+    size_t            size;
+    const Elf64_Ehdr* eh;
+    const Elf64_Phdr* ph;
+} ElfFile;
+
+typedef struct SiteTotal {
+    uint64_t addr;
+    uint64_t blocks;
+    uint64_t bytes;
+} SiteTotal;
+
+#define MAX_ADDRS 64
+
+static ElfFile  exe, core;
+static uint64_t load_bias;   // run-time address minus link-time address (PIE)
+
+static int elf_open(ElfFile* f, const char* path, int type) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        return -1;
+    }
+    f->path = path;
+    f->size = (size_t)st.st_size;
+    f->data = (const char*)mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (f->data == MAP_FAILED || f->size < sizeof(Elf64_Ehdr)) {
+        fprintf(stderr, "%s: cannot map\n", path);
+        return -1;
+    }
+    f->eh = (const Elf64_Ehdr*)f->data;
+    if (memcmp(f->eh->e_ident, ELFMAG, SELFMAG) != 0 || f->eh->e_ident[EI_CLASS] != ELFCLASS64 ||
+        f->eh->e_ident[EI_DATA] != ELFDATA2LSB) {
+        fprintf(stderr, "%s: not a 64-bit little-endian ELF file\n", path);
+        return -1;
+    }
+    if (type == ET_CORE && f->eh->e_type != ET_CORE) {
+        fprintf(stderr, "%s: not a core file\n", path);
+        return -1;
+    }
+    f->ph = (const Elf64_Phdr*)(f->data + f->eh->e_phoff);
+    return 0;
+}
+
+/* Copy len bytes at run-time address addr: from the core, else from the executable */
+static int read_mem(uint64_t addr, void* out, size_t len) {
+    for (int i = 0; i < core.eh->e_phnum; i++) {
+        const Elf64_Phdr* p = &core.ph[i];
+        if (p->p_type == PT_LOAD && addr >= p->p_vaddr && addr + len <= p->p_vaddr + p->p_filesz) {
+            memcpy(out, core.data + p->p_offset + (addr - p->p_vaddr), len);
+            return 0;
+        }
+    }
+    uint64_t link = addr - load_bias;
+    for (int i = 0; i < exe.eh->e_phnum; i++) {
+        const Elf64_Phdr* p = &exe.ph[i];
+        if (p->p_type == PT_LOAD && link >= p->p_vaddr && link + len <= p->p_vaddr + p->p_filesz) {
+            memcpy(out, exe.data + p->p_offset + (link - p->p_vaddr), len);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void read_string(uint64_t addr, char* out, size_t cap) {
+    size_t n = 0;
+    while (n + 1 < cap && read_mem(addr + n, &out[n], 1) == 0 && out[n]) {
+        n++;
+    }
+    out[n] = '\0';
+    if (!n) {
+        snprintf(out, cap, "?");
+    }
+}
+
+/* AT_ENTRY from the core's NT_AUXV note, to find where a PIE was loaded */
+static uint64_t core_entry(void) {
+    for (int i = 0; i < core.eh->e_phnum; i++) {
+        const Elf64_Phdr* p = &core.ph[i];
+        if (p->p_type != PT_NOTE) {
+            continue;
+        }
+        size_t off = 0;
+        while (off + sizeof(Elf64_Nhdr) <= p->p_filesz) {
+            const Elf64_Nhdr* n = (const Elf64_Nhdr*)(core.data + p->p_offset + off);
+            size_t desc = off + sizeof(*n) + ((n->n_namesz + 3) & ~3u);
+            if (n->n_type == NT_AUXV) {
+                const Elf64_auxv_t* av = (const Elf64_auxv_t*)(core.data + p->p_offset + desc);
+                for (size_t k = 0; k < n->n_descsz / sizeof(*av); k++) {
+                    if (av[k].a_type == AT_ENTRY) {
+                        return av[k].a_un.a_val;
+                    }
+                }
+            }
+            off = desc + ((n->n_descsz + 3) & ~3u);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Link-time address of a tracker global. The globals are static, so take
+ * the local symbol that follows leak_tracker.c's STT_FILE entry (LTO may
+ * have added a ".lto_priv.N" suffix); 0 if it is missing.
+ */
+static uint64_t find_symbol(const char* name) {
+    const Elf64_Shdr* sh = (const Elf64_Shdr*)(exe.data + exe.eh->e_shoff);
+    size_t len = strlen(name);
+    uint64_t any = 0;
+    for (int i = 0; i < exe.eh->e_shnum; i++) {
+        if (sh[i].sh_type != SHT_SYMTAB) {
+            continue;
+        }
+        const Elf64_Sym* syms = (const Elf64_Sym*)(exe.data + sh[i].sh_offset);
+        const char* strtab = exe.data + sh[sh[i].sh_link].sh_offset;
+        int in_tracker = 0;
+        for (size_t k = 0; k < sh[i].sh_size / sizeof(Elf64_Sym); k++) {
+            const char* s = strtab + syms[k].st_name;
+            if (ELF64_ST_TYPE(syms[k].st_info) == STT_FILE) {
+                size_t sl = strlen(s);
+                in_tracker = sl >= 14 && strcmp(s + sl - 14, "leak_tracker.c") == 0;
+                continue;
+            }
+            if (ELF64_ST_TYPE(syms[k].st_info) != STT_OBJECT || strncmp(s, name, len) != 0 ||
+                (s[len] != '\0' && s[len] != '.')) {
+                continue;
+            }
+            if (in_tracker) {
+                return syms[k].st_value;
+            }
+            if (!any) {
+                any = syms[k].st_value;
+            }
+        }
+    }
+    return any;
+}
+
+/* Value of a size_t tracker global, or 0 when it is not there */
+static uint64_t read_global(const char* name) {
+    uint64_t addr = find_symbol(name), v = 0;
+    if (addr) {
+        read_mem(addr + load_bias, &v, sizeof(v));
+    }
+    return v;
+}
+
+static void print_site(uint64_t site) {
+    char file[256], where[300];
+    uint64_t file_ptr = 0;
+    int line = 0;
+    if (read_mem(site + offsetof(lt_site, file), &file_ptr, sizeof(file_ptr)) != 0 ||
+        read_mem(site + offsetof(lt_site, line), &line, sizeof(line)) != 0) {
+        snprintf(where, sizeof(where), "(site %#llx)", (unsigned long long)site);
+    } else {
+        read_string(file_ptr, file, sizeof(file));
+        snprintf(where, sizeof(where), "%s:%d", file, line);
+    }
+    printf("%-32s", where);
+}
+
+static int cmp_record_ptr(const void* a, const void* b) {
+    uint64_t x = ((const lt_meta_record*)a)->ptr, y = ((const lt_meta_record*)b)->ptr;
+    return (x > y) - (x < y);
+}
+
+static int cmp_total_bytes(const void* a, const void* b) {
+    uint64_t x = ((const SiteTotal*)a)->bytes, y = ((const SiteTotal*)b)->bytes;
+    return (x < y) - (x > y);
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-a] [-n sites] [-x addr]... <executable> <core>\n", prog);
+}
+
+int main(int argc, char** argv) {
+    int list_all = 0;
+    long max_sites = 20;
+    uint64_t addrs[MAX_ADDRS];
+    int naddrs = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "an:x:h")) != -1) {
+        switch (opt) {
+        case 'a': list_all = 1; break;
+        case 'n': max_sites = atol(optarg); break;
+        case 'x':
+            if (naddrs == MAX_ADDRS) {
+                fprintf(stderr, "At most %d -x addresses\n", MAX_ADDRS);
+                return 1;
+            }
+            addrs[naddrs++] = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind != argc - 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // 1) Open both files and work out where the executable was loaded
+    if (elf_open(&exe, argv[optind], ET_EXEC) != 0 || elf_open(&core, argv[optind + 1], ET_CORE) != 0) {
+        return 1;
+    }
+    if (exe.eh->e_type == ET_DYN) {
+        uint64_t entry = core_entry();
+        if (!entry) {
+            fprintf(stderr, "%s: no AT_ENTRY in the core, cannot place the PIE\n", core.path);
+            return 1;
+        }
+        load_bias = entry - exe.eh->e_entry;
+    }
+
+    // 2) The block table
+    uint64_t table_sym = find_symbol("block_table");
+    uint64_t table = 0, cap = 0;
+    if (!table_sym) {
+        fprintf(stderr, "%s: no block_table symbol (stripped, or built without "
+                        "LEAK_TRACKER_TRACK?)\n", exe.path);
+        return 1;
+    }
+    read_mem(table_sym + load_bias, &table, sizeof(table));
+    cap = read_global("block_cap");
+
+    printf("===== Heap from core %s (%s) =====\n", core.path, exe.path);
+    printf("Tracked allocations:               %llu\n", (unsigned long long)read_global("total_alloc_calls"));
+    printf("Tracked bytes allocated:           %llu\n", (unsigned long long)read_global("total_bytes_allocated"));
+    printf("Tracked bytes freed:               %llu\n", (unsigned long long)read_global("total_bytes_freed"));
+    printf("Double-free attempts:              %llu\n", (unsigned long long)read_global("double_free_count"));
+    printf("Invalid free attempts:             %llu\n", (unsigned long long)read_global("invalid_free_count"));
+    printf("Live blocks:                       %llu (%llu bytes)\n",
+           (unsigned long long)read_global("live_block_count"),
+           (unsigned long long)read_global("live_byte_count"));
+    if (!table || !cap) {
+        printf("\nLive blocks by call site:\n  (none)\n");
+        return 0;
+    }
+
+    lt_meta_record* recs = (lt_meta_record*)malloc(cap * sizeof(*recs));
+    if (!recs) {
+        perror("malloc");
+        return 1;
+    }
+    if (read_mem(table, recs, cap * sizeof(*recs)) != 0) {
+        fprintf(stderr, "%s: block table at %#llx is not in the core (check coredump_filter)\n",
+                core.path, (unsigned long long)table);
+        return 1;
+    }
+
+    // 3) Live records, summed per site (few sites: linear search is fine)
+    size_t ntotals = 0, cap_totals = 64;
+    SiteTotal* totals = (SiteTotal*)malloc(cap_totals * sizeof(*totals));
+    if (!totals) {
+        perror("malloc");
+        return 1;
+    }
+    if (list_all) {
+        printf("\nLive blocks:\n");
+    }
+    for (uint64_t i = 0; i < cap; i++) {
+        const lt_meta_record* r = &recs[i];
+        if (!r->ptr || (r->meta & LT_META_FREED)) {
+            continue;
+        }
+        uint64_t size = r->meta & LT_META_SIZE_MASK;
+        if (list_all) {
+            printf("  %#14llx %10llu bytes  ", (unsigned long long)r->ptr, (unsigned long long)size);
+            print_site(r->site);
+            if (LT_META_TAG(r->meta)) {
+                printf(" [tag %u]", LT_META_TAG(r->meta));
+            }
+            if (LT_META_THREAD(r->meta)) {
+                printf(" [thread %u]", LT_META_THREAD(r->meta));
+            }
+            printf("\n");
+        }
+        size_t k = 0;
+        while (k < ntotals && totals[k].addr != r->site) {
+            k++;
+        }
+        if (k == ntotals) {
+            if (ntotals == cap_totals) {
+                cap_totals *= 2;
+                totals = (SiteTotal*)realloc(totals, cap_totals * sizeof(*totals));
+                if (!totals) {
+                    perror("realloc");
+                    return 1;
+                }
+            }
+            totals[k].addr   = r->site;
+            totals[k].blocks = totals[k].bytes = 0;
+            ntotals++;
+        }
+        totals[k].blocks++;
+        totals[k].bytes += size;
+    }
+
+    // 4) Biggest sites first
+    qsort(totals, ntotals, sizeof(*totals), cmp_total_bytes);
+    printf("\nLive blocks by call site:\n");
+    if (!ntotals) {
+        printf("  (none)\n");
+    }
+    for (size_t k = 0; k < ntotals && (max_sites <= 0 || k < (size_t)max_sites); k++) {
+        printf("  ");
+        print_site(totals[k].addr);
+        printf(" %llu block(s), %llu byte(s)\n",
+               (unsigned long long)totals[k].blocks, (unsigned long long)totals[k].bytes);
+    }
+    if (max_sites > 0 && ntotals > (size_t)max_sites) {
+        printf("  ... %zu more site(s)\n", ntotals - (size_t)max_sites);
+    }
+
+    // 5) The -x addresses: live records sorted by start, the last start at
+    //    or below an address is the only block that can hold it
+    if (naddrs) {
+        size_t nlive = 0;
+        for (uint64_t i = 0; i < cap; i++) {
+            if (recs[i].ptr && !(recs[i].meta & LT_META_FREED)) {
+                recs[nlive++] = recs[i];
+            }
+        }
+        qsort(recs, nlive, sizeof(*recs), cmp_record_ptr);
+        printf("\nAddresses:\n");
+        for (int k = 0; k < naddrs; k++) {
+            size_t lo = 0, hi = nlive;
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (recs[mid].ptr <= addrs[k]) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            const lt_meta_record* r = lo ? &recs[lo - 1] : NULL;
+            uint64_t size = r ? r->meta & LT_META_SIZE_MASK : 0;
+            printf("  %#14llx  ", (unsigned long long)addrs[k]);
+            if (!r || addrs[k] - r->ptr >= (size ? size : 1)) {
+                printf("not in a live tracked block\n");
+                continue;
+            }
+            printf("%llu byte(s) into %#llx (%llu bytes)  ", (unsigned long long)(addrs[k] - r->ptr),
+                   (unsigned long long)r->ptr, (unsigned long long)size);
+            print_site(r->site);
+            printf("\n");
+        }
+    }
+    free(totals);
+    free(recs);
+    return 0;
+}
@@ -0,0 +1,215 @@
+// lt-inspect.c
+//
+// Reads the metadata file a tracked process keeps when started with
+// LEAK_TRACKER_METADATA_FILE=<path> (or after tracker_set_metadata_file())
+// and prints its heap as it was last recorded: the counters, the live
+// blocks summed per call site and, with -a, every live block. Works on the
+// file of a process that is still running or was killed (the OOM killer's
+// SIGKILL leaves no chance for an exit report). Layout: leak_tracker.h.
+//
+// Usage: tools/lt-inspect [-a] [-n sites] <metadata file>
+//
+//   -a         list every live block too
+//   -n sites   call sites to show, largest first (default 20, 0 = all)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// The inspector uses the real allocator; it only needs the file layout
+#ifndef LEAK_TRACKER_DISABLE
+#define LEAK_TRACKER_DISABLE
+#endif
+#include "leak_tracker.h"
+
+typedef struct SiteTotal {
+    const lt_meta_site* site;   // NULL = address not in the site table
+    uint64_t            addr;
+    uint64_t            blocks;
+    uint64_t            bytes;
+} SiteTotal;
+
+static int cmp_site_addr(const void* a, const void* b) {
+    uint64_t x = ((const lt_meta_site*)a)->addr, y = ((const lt_meta_site*)b)->addr;
+    return (x > y) - (x < y);
+}
+
+static int cmp_total_bytes(const void* a, const void* b) {
+    uint64_t x = ((const SiteTotal*)a)->bytes, y = ((const SiteTotal*)b)->bytes;
+    return (x < y) - (x > y);
+}
+
+static const lt_meta_site* find_site(const lt_meta_site* sites, size_t n, uint64_t addr) {
+    lt_meta_site key;
+    key.addr = addr;
+    return (const lt_meta_site*)bsearch(&key, sites, n, sizeof(*sites), cmp_site_addr);
+}
+
+static void print_where(const lt_meta_site* site, uint64_t addr) {
+    char where[300];
+    if (site) {
+        snprintf(where, sizeof(where), "%s:%u", site->file, site->line);
+    } else {
+        snprintf(where, sizeof(where), "(site %#llx)", (unsigned long long)addr);
+    }
+    printf("%-32s", where);
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-a] [-n sites] <metadata file>\n", prog);
+}
+
+int main(int argc, char** argv) {
+    int list_all = 0;
+    long max_sites = 20;
+    int opt;
+    while ((opt = getopt(argc, argv, "an:h")) != -1) {
+        switch (opt) {
+        case 'a': list_all = 1; break;
+        case 'n': max_sites = atol(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char* path = argv[optind];
+
+    // 1) Map the file and check the header
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        return 1;
+    }
+    if ((size_t)st.st_size < sizeof(lt_meta_header)) {
+        fprintf(stderr, "%s: too small for a metadata file\n", path);
+        return 1;
+    }
+    const char* base = (const char*)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    const lt_meta_header* h = (const lt_meta_header*)base;
+    if (memcmp(h->magic, LT_META_MAGIC, sizeof(LT_META_MAGIC)) != 0 || h->version != LT_META_VERSION) {
+        fprintf(stderr, "%s: not a leak tracker metadata file (version %u)\n", path, LT_META_VERSION);
+        return 1;
+    }
+    if (h->site_off + h->site_cap * sizeof(lt_meta_site) > (uint64_t)st.st_size ||
+        h->block_off + h->block_cap * sizeof(lt_meta_record) > (uint64_t)st.st_size ||
+        h->site_count > h->site_cap) {
+        fprintf(stderr, "%s: truncated metadata file\n", path);
+        return 1;
+    }
+
+    printf("===== Heap of pid %llu (%s) =====\n", (unsigned long long)h->pid,
+           h->state == LT_META_EXITED ? "exited normally"
+                                      : "still running, or died without an exit report");
+    if (h->epoch & 1) {
+        printf("Warning: the process stopped while moving its table; records may be missing\n");
+    }
+    printf("Tracked allocations:               %llu\n", (unsigned long long)h->alloc_calls);
+    printf("Tracked bytes allocated:           %llu\n", (unsigned long long)h->bytes_allocated);
+    printf("Tracked bytes freed:               %llu\n", (unsigned long long)h->bytes_freed);
+    printf("Double-free attempts:              %llu\n", (unsigned long long)h->double_frees);
+    printf("Invalid free attempts:             %llu\n", (unsigned long long)h->invalid_frees);
+    printf("Live blocks:                       %llu (%llu bytes)\n",
+           (unsigned long long)h->live_blocks, (unsigned long long)h->live_bytes);
+
+    // 2) Sort a copy of the site table by address for lookups
+    size_t nsites = (size_t)h->site_count;
+    lt_meta_site* sites = (lt_meta_site*)malloc((nsites ? nsites : 1) * sizeof(*sites));
+    if (!sites) {
+        perror("malloc");
+        return 1;
+    }
+    memcpy(sites, base + h->site_off, nsites * sizeof(*sites));
+    qsort(sites, nsites, sizeof(*sites), cmp_site_addr);
+
+    // 3) Walk the table: live blocks, summed per site
+    const lt_meta_record* recs = (const lt_meta_record*)(base + h->block_off);
+    size_t ntotals = 0, cap_totals = 64;
+    SiteTotal* totals = (SiteTotal*)malloc(cap_totals * sizeof(*totals));
+    if (!totals) {
+        perror("malloc");
+        return 1;
+    }
+    if (list_all) {
+        printf("\nLive blocks:\n");
+    }
+    for (uint64_t i = 0; i < h->block_cap; i++) {
+        const lt_meta_record* r = &recs[i];
+        if (!r->ptr || (r->meta & LT_META_FREED)) {
+            continue;
+        }
+        uint64_t size = r->meta & LT_META_SIZE_MASK;
+        const lt_meta_site* site = find_site(sites, nsites, r->site);
+        if (list_all) {
+            printf("  %#14llx %10llu bytes  ", (unsigned long long)r->ptr, (unsigned long long)size);
+            print_where(site, r->site);
+            if (LT_META_TAG(r->meta)) {
+                printf(" [tag %u]", LT_META_TAG(r->meta));
+            }
+            if (LT_META_THREAD(r->meta)) {
+                printf(" [thread %u]", LT_META_THREAD(r->meta));
+            }
+            printf("\n");
+        }
+        // totals[] is kept sorted by site address
+        size_t lo = 0, hi = ntotals;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (totals[mid].addr < r->site) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        size_t k = lo;
+        if (k == ntotals || totals[k].addr != r->site) {
+            if (ntotals == cap_totals) {
+                cap_totals *= 2;
+                totals = (SiteTotal*)realloc(totals, cap_totals * sizeof(*totals));
+                if (!totals) {
+                    perror("realloc");
+                    return 1;
+                }
+            }
+            memmove(&totals[k + 1], &totals[k], (ntotals - k) * sizeof(*totals));
+            totals[k].site   = site;
+            totals[k].addr   = r->site;
+            totals[k].blocks = totals[k].bytes = 0;
+            ntotals++;
+        }
+        totals[k].blocks++;
+        totals[k].bytes += size;
+    }
+
+    // 4) Biggest sites first
+    qsort(totals, ntotals, sizeof(*totals), cmp_total_bytes);
+    printf("\nLive blocks by call site:\n");
+    if (!ntotals) {
+        printf("  (none)\n");
+    }
+    for (size_t k = 0; k < ntotals && (max_sites <= 0 || k < (size_t)max_sites); k++) {
+        printf("  ");
+        print_where(totals[k].site, totals[k].addr);
+        printf(" %llu block(s), %llu byte(s)\n",
+               (unsigned long long)totals[k].blocks, (unsigned long long)totals[k].bytes);
+    }
+    if (max_sites > 0 && ntotals > (size_t)max_sites) {
+        printf("  ... %zu more site(s)\n", ntotals - (size_t)max_sites);
+    }
+    free(totals);
+    free(sites);
+    return 0;
+}
@@ -0,0 +1,127 @@
+#!/bin/bash
+# ========== lt-merge.sh ==========
+# Usage: tools/lt-merge.sh <dir | report files...>
+#
+# Merges the per-process reports a process tree writes when run with
+# LEAK_TRACKER_OUTPUT_DIR=<dir> (one leak_tracker.<pid>.txt per process)
+# into one report:
+#   1. Per process: pid, parent (for forked children), call counts,
+#      bytes allocated and leaks.
+#   2. Aggregate: the totals over all processes.
+#   3. Leaks by call site, summed over processes, largest first.
+
+set -e
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <dir | report files...>"
+    exit 1
+fi
+
+# 1) Collect the report files, in pid order for a directory
+FILES=()
+if [ $# -eq 1 ] && [ -d "$1" ]; then
+    PIDS=()
+    for f in "$1"/leak_tracker.*.txt; do
+        p=${f##*/}
+        p=${p#leak_tracker.}
+        p=${p%.txt}
+        if [[ $p =~ ^[0-9]+$ ]] && [ -f "$f" ]; then
+            PIDS+=("$p")
+        fi
+    done
+    if [ ${#PIDS[@]} -gt 0 ]; then
+        for p in $(printf '%s\n' "${PIDS[@]}" | sort -n); do
+            FILES+=("$1/leak_tracker.$p.txt")
+        done
+    fi
+else
+    FILES=("$@")
+fi
+if [ ${#FILES[@]} -eq 0 ]; then
+    echo "Error: no leak_tracker.<pid>.txt reports found in '$1'"
+    exit 1
+fi
+
+# 2) Parse every report and print the merged view
+awk '
+function num(line) {
+    sub(/^[^:]*: */, "", line)
+    return line + 0
+}
+FNR == 1 {
+    n++
+    pid[n] = FILENAME
+    sub(/.*leak_tracker\./, "", pid[n])
+    sub(/\.txt$/, "", pid[n])
+    parent[n] = "-"
+    allocs[n] = frees[n] = bytes[n] = lblocks[n] = lbytes[n] = 0
+}
+/^===== Memory Leak Report \(pid [0-9]+\)/ {
+    p = $0
+    sub(/.*\(pid /, "", p)
+    sub(/\).*/, "", p)
+    pid[n] = p
+}
+/^Forked from pid [0-9]+/              { parent[n] = $4; sub(/;$/, "", parent[n]) }
+/^Total malloc\/calloc\/realloc calls:/ { allocs[n] = num($0) }
+/^Total free calls:/                   { frees[n]  = num($0) }
+/^Total bytes allocated:/              { bytes[n]  = num($0) }
+# The totals; report=summary prints them without the "Leak at" lines
+/^Summary: [0-9]+ block\(s\) leaked/  { lblocks[n] = $2; lbytes[n] = $6 }
+/^  Leak at / {
+    size = $0
+    sub(/^  Leak at [^:]*: /, "", size)
+    sub(/ bytes.*/, "", size)
+    site = $0
+    sub(/.*\(allocated at /, "", site)
+    sub(/\).*/, "", site)
+    listed++
+    site_blocks[site]++
+    site_bytes[site] += size
+    if (site_seen[site, n]++ == 0) {
+        site_procs[site]++
+    }
+}
+END {
+    printf("===== Merged Leak Report: %d process(es) =====\n\n", n)
+    printf("Per process:\n")
+    printf("  %-8s %-8s %12s %12s %14s %8s %12s\n",
+           "pid", "parent", "allocs", "frees", "bytes", "leaks", "leaked bytes")
+    for (i = 1; i <= n; i++) {
+        printf("  %-8s %-8s %12.0f %12.0f %14.0f %8.0f %12.0f\n",
+               pid[i], parent[i], allocs[i], frees[i], bytes[i], lblocks[i], lbytes[i])
+        tallocs += allocs[i]; tfrees += frees[i]; tbytes += bytes[i]
+        tlblocks += lblocks[i]; tlbytes += lbytes[i]
+        if (lblocks[i]) {
+            leaky++
+        }
+    }
+    printf("\nAggregate:\n")
+    printf("Total malloc/calloc/realloc calls: %.0f\n", tallocs)
+    printf("Total free calls:                  %.0f\n", tfrees)
+    printf("Total bytes allocated:             %.0f\n", tbytes)
+    if (!tlblocks) {
+        printf("No leaks detected!\n")
+        exit
+    }
+    printf("Leaked: %.0f block(s), %.0f byte(s) in %d process(es)\n", tlblocks, tlbytes, leaky)
+    printf("\nLeaks by call site:\n")
+    if (listed < tlblocks) {
+        printf("  (%.0f block(s) not listed: report=summary)\n", tlblocks - listed)
+    }
+    # Largest first (insertion sort; there are few distinct sites)
+    m = 0
+    for (site in site_blocks) {
+        k = ++m
+        while (k > 1 && site_bytes[order[k - 1]] < site_bytes[site]) {
+            order[k] = order[k - 1]
+            k--
+        }
+        order[k] = site
+    }
+    for (k = 1; k <= m; k++) {
+        site = order[k]
+        printf("  %-32s %.0f block(s), %.0f byte(s) in %d process(es)\n",
+               site, site_blocks[site], site_bytes[site], site_procs[site])
+    }
+}' "${FILES[@]}"